@@ -0,0 +1,553 @@
+/*******************************************************************************
+Host benchmark of the bus cost of the library API.
+
+A counting HAL sits between the library and the virtual HT1621. For every
+public entry point and for a few meter screen sequences it reports chip select
+frames, clock edges, HAL calls and the bus time emulated from the timing
+profile, over bit level pins and over Transmit(). RAM readback exists over pins
+only, so HT1620Scrub() sequences are reported as unsupported over Transmit().
+
+Results are compared with bench_bus.baseline: any number above its baseline
+fails the run. `bench_bus --update` writes the current numbers as the baseline.
+*******************************************************************************/
+
+#include "ht1621_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BASELINE_FILE "bench_bus.baseline"
+#define NAME_SIZE 48
+#define RESULTS_MAX 64
+
+typedef struct
+{
+    uint32_t frames;
+    uint32_t edges;
+    uint32_t calls;
+    uint64_t busNs;
+} cost_st;
+
+typedef struct
+{
+    char name[NAME_SIZE];
+    cost_st cost;
+} result_st;
+
+static result_st results[RESULTS_MAX];
+static uint8_t resultsCount;
+
+static const HT1620_Timing_st *timing = &HT1620_TIMING_3V;
+static HT1620_HAL_st chip; // simulator pins behind the counting HAL
+static HT1621Sim_st sim;
+static HT1620_ctx lcd;
+static cost_st cost;
+
+/**
+ * @brief COUNTING HAL BLOCK
+ */
+static void countCs(bool level)
+{
+    cost.calls++;
+    if (!level)
+        cost.frames++;
+    chip.PinCs(level);
+}
+
+static void countSck(bool level)
+{
+    cost.calls++;
+    cost.edges++;
+    chip.PinSck(level);
+}
+
+static void countMosi(bool level)
+{
+    cost.calls++;
+    chip.PinMosi(level);
+}
+
+static void countTransmit(const uint8_t *data, uint8_t size, uint16_t bits)
+{
+    // SPI clocks whole bytes at the profile clock
+    cost.calls++;
+    cost.edges += size * 8U * 2;
+    cost.busNs += size * 8ULL * (timing->ClkLowNs + timing->ClkHighNs);
+    chip.Transmit(data, size, bits);
+}
+
+static void countRd(bool level)
+{
+    cost.calls++;
+    cost.edges++;
+    chip.PinRd(level);
+}
+
+static bool countData(void)
+{
+    cost.calls++;
+    return chip.PinData();
+}
+
+static void countDataDir(bool input)
+{
+    cost.calls++;
+    chip.PinDataDir(input);
+}
+
+static void countDelay(uint32_t ns)
+{
+    cost.busNs += ns;
+}
+
+static void start(bool transmit)
+{
+    static HT1620_HAL_st hal;
+
+    HT1621SimReset(&sim);
+    HT1621SimBind(&sim, &chip, transmit);
+    hal.PinCs = countCs;
+    hal.PinSck = transmit ? 0 : countSck;
+    hal.PinMosi = transmit ? 0 : countMosi;
+    hal.Transmit = transmit ? countTransmit : 0;
+    hal.DelayNs = countDelay;
+    hal.PinRd = transmit ? 0 : countRd;
+    hal.PinData = transmit ? 0 : countData;
+    hal.PinDataDir = transmit ? 0 : countDataDir;
+
+    HT1620Init(&lcd, &hal);
+    HT1620SetTiming(&lcd, timing);
+}
+
+static void record(const char *transport, const char *name)
+{
+    if (resultsCount == RESULTS_MAX)
+    {
+        fprintf(stderr, "too many results\n");
+        exit(2);
+    }
+
+    result_st *r = &results[resultsCount++];
+    snprintf(r->name, sizeof(r->name), "%s/%s", transport, name);
+    r->cost = cost;
+    memset(&cost, 0, sizeof(cost));
+}
+
+/**
+ * @brief SCENARIOS BLOCK
+ *
+ * Single calls start from a typical screen, so they show the cost of a change
+ * rather than of the first full write
+ */
+static void typicalScreen()
+{
+    HT1620BeginUpdate(&lcd);
+    HT1620printFixed(&lcd, 123456, 1000);
+    HT1620DispFlowM3(&lcd, true, true, false);
+    HT1620batteryLevel(&lcd, 80);
+    HT1620SignalLevel(&lcd, 50);
+    HT1620Commit(&lcd);
+    memset(&cost, 0, sizeof(cost));
+}
+
+static void callInit()
+{
+    HT1620Init(&lcd, lcd.hal);
+    HT1620SetTiming(&lcd, timing);
+}
+
+static void callPrintNum()
+{
+    HT1620printNum(&lcd, 123457);
+}
+
+static void callPrintFloat()
+{
+    HT1620printFloat(&lcd, 123.458f, 3);
+}
+
+static void callPrintFixed()
+{
+    HT1620printFixed(&lcd, 123459, 1000);
+}
+
+static void callPrintStr()
+{
+    HT1620printStr(&lcd, "ERR 42");
+}
+
+static void callBatteryLevel()
+{
+    HT1620batteryLevel(&lcd, 40);
+}
+
+static void callClear()
+{
+    HT1620clear(&lcd);
+}
+
+static void callDisplayOff()
+{
+    HT1620displayOff(&lcd);
+}
+
+static void callDisplayOn()
+{
+    HT1620displayOn(&lcd);
+}
+
+static void callRefresh()
+{
+    HT1620Refresh(&lcd);
+}
+
+static void callSymbol()
+{
+    HT1620DispWarn(&lcd, true);
+    HT1620Commit(&lcd);
+}
+
+// volume counter: a few last digits change per update, battery and signal now and then
+static void seqWaterMeter()
+{
+    for (int32_t i = 0; i < 60; i++)
+    {
+        HT1620BeginUpdate(&lcd);
+        HT1620printFixed(&lcd, 123456 + i * 7, 1000);
+        if (i % 10 == 0)
+            HT1620batteryLevel(&lcd, 100 - i);
+        if (i % 20 == 0)
+            HT1620SignalLevel(&lcd, i * 2);
+        HT1620Commit(&lcd);
+    }
+}
+
+// the same counter posted from the pulse ISR, display task flushes every 5th count
+static void seqWaterMeterPosted()
+{
+    for (int32_t i = 0; i < 60; i++)
+    {
+        HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_FIXED, .value = 123456 + i * 7, .arg = 1000});
+        if (i % 10 == 0)
+            HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_BATTERY, .value = 100 - i});
+        if (i % 20 == 0)
+            HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_SIGNAL, .value = i * 2});
+        if (i % 5 == 4)
+            HT1620FlushUpdates(&lcd);
+    }
+}
+
+// heat meter carousel: energy, flow and temperature screens in turn
+static void seqHeatCarousel()
+{
+    for (int32_t i = 0; i < 20; i++)
+    {
+        HT1620BeginUpdate(&lcd);
+        HT1620DispFlowM3(&lcd, false, false, false);
+        HT1620DispT(&lcd, false);
+        HT1620DispEnergyJ(&lcd, true, true, false);
+        HT1620printFixed(&lcd, 4567 + i, 100);
+        HT1620Commit(&lcd);
+
+        HT1620BeginUpdate(&lcd);
+        HT1620DispEnergyJ(&lcd, false, false, false);
+        HT1620DispFlowM3(&lcd, true, true, true);
+        HT1620printFloat(&lcd, 1.25f + i * 0.01f, 3);
+        HT1620Commit(&lcd);
+
+        HT1620BeginUpdate(&lcd);
+        HT1620DispFlowM3(&lcd, false, false, false);
+        HT1620DispT(&lcd, true);
+        HT1620printNum(&lcd, 45 + i % 3);
+        HT1620Commit(&lcd);
+    }
+}
+
+// the same three screens as pages: one flush of the difference per page switch
+static int32_t pageValue;
+
+static void pageEnergy(HT1620_ctx *ctx, void *arg)
+{
+    (void)arg;
+    HT1620DispEnergyJ(ctx, true, true, false);
+    HT1620printFixed(ctx, 4567 + pageValue, 100);
+}
+
+static void pageFlow(HT1620_ctx *ctx, void *arg)
+{
+    (void)arg;
+    HT1620DispFlowM3(ctx, true, true, true);
+    HT1620printFloat(ctx, 1.25f + pageValue * 0.01f, 3);
+}
+
+static void pageTemp(HT1620_ctx *ctx, void *arg)
+{
+    (void)arg;
+    HT1620DispT(ctx, true);
+    HT1620printNum(ctx, 45 + pageValue % 3);
+}
+
+static const HT1620_Page_st pages[] = {
+    {.render = pageEnergy, .dwell = 5},
+    {.render = pageFlow, .dwell = 5},
+    {.render = pageTemp, .dwell = 5},
+};
+
+#define PAGES_COUNT (sizeof(pages) / sizeof(pages[0]))
+
+static void seqPageCarousel()
+{
+    pageValue = 0;
+    HT1620Carousel(&lcd, pages, PAGES_COUNT);
+    for (uint16_t i = 1; i < 20 * PAGES_COUNT * 5; i++)
+    {
+        pageValue = i / (PAGES_COUNT * 5);
+        HT1620CarouselTick(&lcd);
+    }
+}
+
+// the same pages switched the way applications did before: clear(), then every call flushes
+static void seqClearRedraw()
+{
+    for (uint16_t i = 0; i < 20 * PAGES_COUNT; i++)
+    {
+        pageValue = i / PAGES_COUNT;
+        HT1620clear(&lcd);
+        pages[i % PAGES_COUNT].render(&lcd, 0);
+    }
+}
+
+// value does not change between refreshes
+static void seqIdleRefresh()
+{
+    for (int32_t i = 0; i < 100; i++)
+        HT1620printNum(&lcd, 4242);
+}
+
+// service menu labels
+static void seqMenuText()
+{
+    static const char *labels[] = {"SN", "VER 12", "CRC OK", "ERR 0", "LEAK", "BAT 95"};
+
+    for (uint8_t r = 0; r < 5; r++)
+    {
+        for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++)
+            HT1620printStr(&lcd, labels[i]);
+    }
+}
+
+// serial number marquee over the meter screen, one full turn
+static void seqScroll()
+{
+    static const char text[] = "SN 0123456789 FW 12";
+
+    HT1620Scroll(&lcd, text, 1);
+    for (uint8_t i = 0; i < sizeof(text) - 1 + DISPLAY_SIZE; i++)
+        HT1620ScrollTick(&lcd);
+}
+
+// value editing: one digit and WARN blink for 20 phases
+static void seqBlink()
+{
+    HT1620BlinkSymbols(&lcd, HT1620_SYM(HT1620_SYM_WARN), 0);
+    HT1620BlinkDigits(&lcd, 1 << 4);
+    for (uint8_t i = 0; i < 20; i++)
+        HT1620BlinkTick(&lcd);
+}
+
+// periodic readback of the whole RAM in chunks, one corrupted address
+static void seqScrub()
+{
+    HT1621SimFlip(&sim, 12, 0x02);
+    for (uint8_t i = 0; i < HT1620_RAM_SIZE / 8; i++)
+        HT1620Scrub(&lcd, 8);
+}
+
+typedef struct
+{
+    const char *name;
+    void (*run)(void);
+    bool fromScreen; // start from typicalScreen() instead of a cleared display
+    bool pinsOnly;   // RAM readback, unsupported over Transmit()
+} scenario_st;
+
+static const scenario_st scenarios[] = {
+    {"HT1620Init", callInit, false, false},
+    {"HT1620printNum", callPrintNum, true, false},
+    {"HT1620printFloat", callPrintFloat, true, false},
+    {"HT1620printFixed", callPrintFixed, true, false},
+    {"HT1620printStr", callPrintStr, true, false},
+    {"HT1620batteryLevel", callBatteryLevel, true, false},
+    {"HT1620clear", callClear, true, false},
+    {"HT1620displayOff", callDisplayOff, true, false},
+    {"HT1620displayOn", callDisplayOn, true, false},
+    {"HT1620Refresh", callRefresh, true, false},
+    {"HT1620DispWarn+Commit", callSymbol, true, false},
+    {"seq:water-meter", seqWaterMeter, true, false},
+    {"seq:water-meter-posted", seqWaterMeterPosted, true, false},
+    {"seq:heat-carousel", seqHeatCarousel, true, false},
+    {"seq:idle-refresh", seqIdleRefresh, true, false},
+    {"seq:menu-text", seqMenuText, false, false},
+    {"seq:scroll", seqScroll, true, false},
+    {"seq:blink", seqBlink, true, false},
+    {"seq:scrub", seqScrub, true, true},
+    {"seq:page-carousel", seqPageCarousel, false, false},
+    {"seq:clear-redraw", seqClearRedraw, false, false},
+};
+
+#define SCENARIOS_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static bool runAll()
+{
+    bool ok = true;
+
+    for (uint8_t t = 0; t < 2; t++)
+    {
+        bool transmit = t;
+        const char *transport = transmit ? "spi" : "pins";
+
+        for (size_t i = 0; i < SCENARIOS_COUNT; i++)
+        {
+            if (transmit && scenarios[i].pinsOnly)
+            {
+                // nothing to measure, a 0 row would pass any baseline
+                printf("%s/%s: unsupported, skipped\n", transport, scenarios[i].name);
+                continue;
+            }
+
+            start(transmit);
+            HT1620clear(&lcd);
+            memset(&cost, 0, sizeof(cost));
+            if (scenarios[i].fromScreen)
+                typicalScreen();
+
+            scenarios[i].run();
+            record(transport, scenarios[i].name);
+
+            if (sim.stats.errors)
+            {
+                printf("%s/%s: %lu bus errors\n", transport, scenarios[i].name, (unsigned long)sim.stats.errors);
+                ok = false;
+            }
+        }
+    }
+
+    return ok;
+}
+
+/**
+ * @brief BASELINE BLOCK
+ */
+static bool baselineFind(FILE *f, const char *name, cost_st *out)
+{
+    char line[128];
+    char key[NAME_SIZE];
+    unsigned long frames, edges, calls;
+    unsigned long long busNs;
+
+    rewind(f);
+    while (fgets(line, sizeof(line), f))
+    {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%47s %lu %lu %lu %llu", key, &frames, &edges, &calls, &busNs) == 5 && !strcmp(key, name))
+        {
+            out->frames = frames;
+            out->edges = edges;
+            out->calls = calls;
+            out->busNs = busNs;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool baselineWrite(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+        return false;
+
+    fprintf(f, "# bench_bus results: name frames clock_edges hal_calls bus_ns (HT1620_TIMING_3V)\n");
+    for (uint8_t i = 0; i < resultsCount; i++)
+    {
+        const cost_st *c = &results[i].cost;
+        fprintf(f, "%s %lu %lu %lu %llu\n", results[i].name, (unsigned long)c->frames, (unsigned long)c->edges,
+                (unsigned long)c->calls, (unsigned long long)c->busNs);
+    }
+
+    return !fclose(f);
+}
+
+static const char *mark(uint64_t value, uint64_t base, bool *regressed)
+{
+    if (value > base)
+    {
+        *regressed = true;
+        return "+";
+    }
+
+    return (value < base) ? "-" : " ";
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = BASELINE_FILE;
+    bool update = false;
+    bool ok;
+    FILE *baseline;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--update"))
+            update = true;
+        else
+            path = argv[i];
+    }
+
+    ok = runAll();
+
+    if (update)
+    {
+        if (!baselineWrite(path))
+        {
+            fprintf(stderr, "can't write %s\n", path);
+            return 2;
+        }
+        printf("baseline %s written\n", path);
+        return ok ? 0 : 1;
+    }
+
+    baseline = fopen(path, "r");
+    if (!baseline)
+        fprintf(stderr, "no baseline %s, results are not checked\n", path);
+
+    printf("%-32s %8s %10s %10s %12s   (+ worse, - better than baseline)\n", "", "frames", "edges", "calls", "bus us");
+    for (uint8_t i = 0; i < resultsCount; i++)
+    {
+        const cost_st *c = &results[i].cost;
+        cost_st base;
+        bool regressed = false;
+        bool known = baseline && baselineFind(baseline, results[i].name, &base);
+
+        if (!known)
+            base = *c;
+
+        printf("%-32s %7lu%s %9lu%s %9lu%s %11.1f%s%s\n", results[i].name,
+               (unsigned long)c->frames, mark(c->frames, base.frames, &regressed),
+               (unsigned long)c->edges, mark(c->edges, base.edges, &regressed),
+               (unsigned long)c->calls, mark(c->calls, base.calls, &regressed),
+               c->busNs / 1000.0, mark(c->busNs, base.busNs, &regressed),
+               (baseline && !known) ? "  (new)" : "");
+
+        if (regressed)
+            ok = false;
+    }
+
+    if (baseline)
+        fclose(baseline);
+
+    printf("%s\n", ok ? "OK" : "FAILED: bus cost is above the baseline");
+    return ok ? 0 : 1;
+}
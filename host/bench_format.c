@@ -0,0 +1,132 @@
+/*******************************************************************************
+Host benchmark of HT1620printNum() number formatting.
+
+Compares the segment encoder used by the library with the former
+snprintf("%6li") + bufferToAscii() path, and checks that both give the same
+segments. Checks floatScale() of HT1620printFloat() against a double reference.
+Linked with the library object, internals come from HT1620_format.h.
+*******************************************************************************/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "HT1620.h"
+#include "HT1620_format.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#define CYCLES() 0ULL
+#endif
+
+#define ROUNDS 200000
+#define FLOAT_CASES 1000000
+#define FLOAT_PRECISION_MAX 5
+
+static const int32_t values[] = {0, 7, -3, 42, 1234, -56789, 123456, 999999, -99999, 1000000, 87654321, MAX_NUM, MIN_NUM};
+#define VALUES_COUNT (sizeof(values) / sizeof(values[0]))
+
+// HT1620printNum() formatting before the segment encoder
+static void snprintfPath(int32_t num, uint8_t *out)
+{
+    char str[12];
+
+    snprintf(str, sizeof(str), "%6li", (long)num);
+    str[DISPLAY_SIZE] = 0; // former buffer only held DISPLAY_SIZE characters
+    bufferToAscii(str, out);
+}
+
+static void encoderPath(int32_t num, uint8_t *out)
+{
+    numToSegments(num, out);
+}
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench(const char *name, void (*format)(int32_t, uint8_t *))
+{
+    static uint8_t out[DISPLAY_BUFFER_SIZE];
+    uint64_t ns = nowNs();
+    uint64_t cycles = CYCLES();
+
+    for (uint32_t r = 0; r < ROUNDS; r++)
+    {
+        for (size_t i = 0; i < VALUES_COUNT; i++)
+        {
+            memset(out, 0, sizeof(out));
+            format(values[i], out);
+        }
+    }
+
+    cycles = CYCLES() - cycles;
+    ns = nowNs() - ns;
+    printf("%-10s %8.1f ns/call %8.1f cycles/call\n", name,
+           (double)ns / (ROUNDS * VALUES_COUNT), (double)cycles / (ROUNDS * VALUES_COUNT));
+}
+
+// the same value as floatScale() with double math: exact, float mantissa times 10^5 fits 53 bits
+static uint32_t floatScaleRef(float num, uint8_t precision)
+{
+    double scaled = floor(fabs((double)num) * pow(10, precision) + 0.5);
+
+    if (isnan(num) || scaled > MAX_NUM)
+        return MAX_NUM;
+    return (uint32_t)scaled;
+}
+
+static int floatCheck()
+{
+    int mismatches = 0;
+
+    srand(1);
+    for (uint32_t i = 0; i < FLOAT_CASES; i++)
+    {
+        // random bit patterns cover every exponent, denormals, inf and nan included
+        uint32_t bits = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        uint8_t precision = i % (FLOAT_PRECISION_MAX + 1);
+        float num;
+
+        memcpy(&num, &bits, sizeof(num));
+        if (floatScale(bits & 0x7FFFFFFFUL, precision) != floatScaleRef(num, precision))
+        {
+            if (mismatches++ < 10)
+                printf("floatScale differs for %.9g, precision %u\n", num, precision);
+        }
+    }
+
+    return mismatches;
+}
+
+int main()
+{
+    int mismatches = floatCheck();
+
+    for (size_t i = 0; i < VALUES_COUNT; i++)
+    {
+        uint8_t expected[DISPLAY_BUFFER_SIZE] = {0};
+        uint8_t actual[DISPLAY_BUFFER_SIZE] = {0};
+
+        snprintfPath(values[i], expected);
+        encoderPath(values[i], actual);
+        if (memcmp(expected, actual, sizeof(expected)))
+        {
+            printf("segments differ for %li\n", (long)values[i]);
+            mismatches++;
+        }
+    }
+
+    bench("snprintf", snprintfPath);
+    bench("encoder", encoderPath);
+
+    return mismatches ? 1 : 0;
+}
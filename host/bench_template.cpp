@@ -0,0 +1,182 @@
+/*******************************************************************************
+Host check of the C++ front-end (src/HT1620.hpp).
+
+Runs the same screen sequence through the C API over bit level HAL pins and
+through HT1620<Transport> whose pins drive the virtual HT1621 directly. Both
+chips must end up with the same RAM and bits on the wire, and the template must
+need far fewer indirect HAL calls, delays included: it only goes through the
+HAL for chip select, its delays and one Transmit() per frame. The template HAL
+is wrapped in a counting shim, so every call through its function pointers is
+counted; delays inlined into the bit loop are counted apart from them.
+Exit code is not 0 if any check fails.
+*******************************************************************************/
+
+extern "C" {
+#include "ht1621_sim.h"
+}
+#include "HT1620.hpp"
+#include <string.h>
+
+static HT1621Sim_st simC;
+static HT1621Sim_st simT;
+static uint32_t callsC; // DelayNs() calls of the C API run, pin calls are counted by the simulator
+static uint32_t callsT;  // calls through the function pointers of the template HAL
+static uint32_t inlineT; // delays of the template bit loop, inlined instead of a HAL call
+static bool inHal;       // a shim call is running, its delay is not an inline one
+
+// pins of the template, inlined into its bit loop
+struct SimBus
+{
+    static void cs(bool level)
+    {
+        HT1621SimPinCs(&simT, level);
+    }
+    static void wr(bool level)
+    {
+        HT1621SimPinSck(&simT, level);
+    }
+    static void data(bool level)
+    {
+        HT1621SimPinMosi(&simT, level);
+    }
+    static void delayNs(uint32_t ns)
+    {
+        (void)ns;
+        if (!inHal)
+            inlineT++;
+    }
+};
+
+/**
+ * Counting shim: sits between the C library and the HAL built by the template,
+ * counts every call and forwards it
+ */
+static HT1620_HAL_st halT; // the template HAL
+
+static void shimCs(bool level)
+{
+    callsT++;
+    halT.PinCs(level);
+}
+
+static void shimSck(bool level)
+{
+    callsT++;
+    halT.PinSck(level);
+}
+
+static void shimMosi(bool level)
+{
+    callsT++;
+    halT.PinMosi(level);
+}
+
+static void shimTransmit(const uint8_t *data, uint8_t size, uint16_t bits)
+{
+    callsT++;
+    halT.Transmit(data, size, bits);
+}
+
+static void shimDelayNs(uint32_t ns)
+{
+    callsT++;
+    inHal = true;
+    halT.DelayNs(ns);
+    inHal = false;
+}
+
+// puts the shim in front of the HAL of ctx, hooks the template leaves empty stay empty
+static void shimInstall(HT1620_ctx *ctx)
+{
+    static HT1620_HAL_st shim;
+
+    halT = *ctx->hal;
+    shim = halT;
+    shim.PinCs = halT.PinCs ? shimCs : nullptr;
+    shim.PinSck = halT.PinSck ? shimSck : nullptr;
+    shim.PinMosi = halT.PinMosi ? shimMosi : nullptr;
+    shim.Transmit = halT.Transmit ? shimTransmit : nullptr;
+    shim.DelayNs = halT.DelayNs ? shimDelayNs : nullptr;
+    if (shim.PinRd || shim.PinData || shim.TransmitAsync || shim.PinDataDir || shim.Timestamp)
+        printf("shim: template HAL has hooks that are not counted\n");
+    ctx->hal = &shim;
+}
+
+static void delayC(uint32_t ns)
+{
+    (void)ns;
+    callsC++;
+}
+
+static void screens(HT1620_ctx *ctx)
+{
+    HT1620printNum(ctx, 123456);
+    HT1620printStr(ctx, "HELLO");
+    HT1620printFloat(ctx, -3.25f, 2);
+    HT1620batteryLevel(ctx, 60);
+    HT1620SetSymbols(ctx, HT1620_SYM(HT1620_SYM_WARN) | HT1620_SYM(HT1620_SYM_M3), 0);
+    HT1620BeginUpdate(ctx);
+    HT1620printFixed(ctx, 987654, 1000);
+    HT1620DispT(ctx, true);
+    HT1620Commit(ctx);
+    HT1620clear(ctx);
+    HT1620printNum(ctx, 42);
+}
+
+int main()
+{
+    static HT1620_ctx lcdC;
+    static HT1620<SimBus, HT1620Timing5V> lcdT;
+    HT1620_HAL_st hal = {};
+    int failures = 0;
+
+    HT1621SimReset(&simC);
+    HT1621SimReset(&simT);
+    HT1621SimBind(&simC, &hal, false);
+    hal.DelayNs = delayC;
+
+    // HAL calls are counted over the screens only, the template gets its shim after init()
+    HT1620Init(&lcdC, &hal);
+    HT1620SetTiming(&lcdC, &HT1620_TIMING_5V);
+    callsC = 0;
+    simC.stats.pinCalls = 0;
+    screens(&lcdC);
+    callsC += simC.stats.pinCalls;
+
+    lcdT.init();
+    shimInstall(lcdT);
+    inlineT = 0;
+    screens(lcdT);
+
+    printf("%-12s %8s %8s %10s %14s\n", "", "frames", "bits", "HAL calls", "inline delays");
+    printf("%-12s %8lu %8lu %10lu %14s\n", "C, HAL pins", (unsigned long)simC.stats.frames,
+           (unsigned long)simC.stats.bits, (unsigned long)callsC, "-");
+    printf("%-12s %8lu %8lu %10lu %14lu\n", "HT1620<>", (unsigned long)simT.stats.frames,
+           (unsigned long)simT.stats.bits, (unsigned long)callsT, (unsigned long)inlineT);
+    HT1621SimRender(&simT, stdout);
+
+    if (memcmp(simC.ram, simT.ram, sizeof(simC.ram)) || simC.stats.frames != simT.stats.frames)
+    {
+        printf("FAIL: template and C API drive the chip differently\n");
+        failures++;
+    }
+    if (simC.stats.bits != simT.stats.bits)
+    {
+        printf("FAIL: template clocks %lu bits, C API %lu\n", (unsigned long)simT.stats.bits,
+               (unsigned long)simC.stats.bits);
+        failures++;
+    }
+    if (simT.stats.errors || simC.stats.errors)
+    {
+        printf("FAIL: bus errors\n");
+        failures++;
+    }
+    if (callsT * 4 > callsC)
+    {
+        printf("FAIL: template makes %lu indirect calls, C API %lu\n", (unsigned long)callsT, (unsigned long)callsC);
+        failures++;
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,529 @@
+/*******************************************************************************
+Virtual HT1621 for host builds. See ht1621_sim.h
+*******************************************************************************/
+
+#include "ht1621_sim.h"
+#include "HT1620_layout.h"
+#include <string.h>
+
+/**
+ * @brief HT1621 PROTOCOL DEFINES BLOCK
+ *
+ * Frame: 3 bit ID, MSB first. Write: 6 bit address A5..A0, then 4 bits D0..D3
+ * per address, address increments after every 4 bits. Read: the same address,
+ * then D0..D3 go out on RD falling edges. Command: any number of 9 bit
+ * commands C8..C0, C0 is don't care.
+ */
+#define ID_BITS 3
+#define ADDR_BITS 6
+#define NIBBLE_BITS 4
+#define CMD_BITS 9
+#define DATA_OFFSET (ID_BITS + ADDR_BITS)
+
+#define ID_CMD 0x04   //0b100
+#define ID_WRITE 0x05 //0b101
+#define ID_READ 0x06  //0b110
+
+#define CMD_CODE(C) ((C) & ~1U) // drop C0
+#define CMD_BIAS_MASK 0x1E0
+#define CMD_BIAS_CODE 0x040 //0b0010abXcX
+
+#define DIGIT_WIDTH 4
+#define DOTS_COUNT 5
+
+/**
+ * @brief GLASS ICONS BLOCK
+ *
+ * Single segment icons in the order they are printed. Digits, dots,
+ * battery and signal bars are drawn separately
+ */
+typedef struct
+{
+    const char *name;
+    uint8_t pos;
+    uint8_t seg;
+} icon_st;
+
+#define ICON(NAME, SYM) {NAME, SYM##_POS, SYM##_SEG}
+
+static const icon_st icons[] = {
+    ICON("-", MINUS),
+    ICON("MIN", MIN_RU),
+    ICON("MAX", MAX_RU),
+    ICON("MIN(en)", MIN_EN),
+    ICON("MAX(en)", MAX_EN),
+    ICON("BURST", BURST_RU),
+    ICON("BURST(en)", BURST_EN),
+    ICON("LEAK", LEAK_RU),
+    ICON("LEAK(en)", LEAK_EN),
+    ICON("REV", REV_RU),
+    ICON("REV(en)", REV_EN),
+    ICON("FROST", FROST),
+    ICON("Q", Q),
+    ICON("VER", VER_RU),
+    ICON("VER(en)", VER_EN),
+    ICON("SN", SN_RU),
+    ICON("SN(en)", SN_EN),
+    ICON("WARN", WARN),
+    ICON("MAGNET", MAGNET),
+    ICON("<", LEFT),
+    ICON(">", RIGHT),
+    ICON("NOWATER", NOWATER),
+    ICON("CRC", CRC),
+    ICON("DELTA", DELTA),
+    ICON("T", T),
+    ICON("1", T1),
+    ICON("T2", T2),
+    ICON("NBFi", NBFI),
+    ICON("NBIoT", NBIOT),
+    ICON("DEGREE", DEGREE),
+    ICON("Gcal", GCAL),
+    ICON("Gcal/h", GCAL_H),
+    ICON("GJ", GJ),
+    ICON("GJ/h", GJ_H),
+    ICON("k", KW),
+    ICON("M", MW),
+    ICON("W", W),
+    ICON("h", WH),
+    ICON("GAL", GAL),
+    ICON("GAL/min", GAL_PM),
+    ICON("m3", M3),
+    ICON("m3/h", M3_H),
+    ICON("m3/h(en)", M3_H_EN),
+    ICON("ft3", FT3),
+    ICON("ft3/min", FT3_PM),
+    ICON("MMBTU", MMBTU),
+    ICON("gallons", GALLONS),
+    ICON("US", US),
+};
+
+#define ICONS_COUNT (sizeof(icons) / sizeof(icons[0]))
+
+static HT1621Sim_st *bound[HT1621_SIM_MAX];
+
+void HT1621SimReset(HT1621Sim_st *sim)
+{
+    uint8_t bus = sim->bus;
+
+    memset(sim, 0, sizeof(*sim));
+    sim->bus = bus;
+    sim->cs = true;
+    sim->sck = true;
+    sim->rd = true;
+    sim->data = true;
+}
+
+static void simCommand(HT1621Sim_st *sim, uint16_t cmd)
+{
+    sim->stats.commands++;
+
+    switch (CMD_CODE(cmd))
+    {
+    case HT1620_CMD_SYSDIS:
+        // stops the oscillator and the bias generator both
+        sim->sysEnabled = false;
+        sim->lcdOn = false;
+        break;
+    case HT1620_CMD_SYSEN:
+        sim->sysEnabled = true;
+        break;
+    case HT1620_CMD_LCDOFF:
+        sim->lcdOn = false;
+        break;
+    case HT1620_CMD_LCDON:
+        sim->lcdOn = true;
+        break;
+    default:
+        if ((cmd & CMD_BIAS_MASK) == CMD_BIAS_CODE)
+            sim->bias = CMD_CODE(cmd);
+        break;
+    }
+}
+
+static void simBit(HT1621Sim_st *sim, bool bit)
+{
+    uint16_t n = sim->bitCount++;
+
+    sim->stats.bits++;
+
+    if (n < ID_BITS)
+    {
+        sim->mode = (sim->mode << 1) | bit;
+        if (n == ID_BITS - 1 && sim->mode != ID_CMD && sim->mode != ID_WRITE && sim->mode != ID_READ)
+            sim->stats.errors++;
+        return;
+    }
+
+    if (sim->mode == ID_CMD)
+    {
+        sim->shift = (sim->shift << 1) | bit;
+        if ((n - ID_BITS) % CMD_BITS == CMD_BITS - 1)
+        {
+            simCommand(sim, sim->shift);
+            sim->shift = 0;
+        }
+    }
+    else if (sim->mode == ID_READ)
+    {
+        // data goes out on RD, WR past the address is ignored
+        if (n < DATA_OFFSET)
+            sim->addr = ((sim->addr << 1) | bit) % HT1620_RAM_SIZE;
+        else
+            sim->stats.errors++;
+    }
+    else if (sim->mode == ID_WRITE)
+    {
+        if (n < DATA_OFFSET)
+        {
+            sim->addr = ((sim->addr << 1) | bit) % HT1620_RAM_SIZE;
+            return;
+        }
+
+        uint8_t k = (n - DATA_OFFSET) % NIBBLE_BITS;
+        sim->shift |= bit << k;
+        if (k == NIBBLE_BITS - 1)
+        {
+            sim->ram[sim->addr] = sim->shift;
+            sim->addr = (sim->addr + 1) % HT1620_RAM_SIZE;
+            sim->stats.writes++;
+            sim->shift = 0;
+        }
+    }
+}
+
+void HT1621SimPinCs(HT1621Sim_st *sim, bool level)
+{
+    if (level == sim->cs)
+        return;
+
+    sim->cs = level;
+    if (!level)
+    {
+        sim->bitCount = 0;
+        sim->shift = 0;
+        sim->mode = 0;
+        sim->addr = 0;
+        return;
+    }
+
+    // incomplete command or data nibble is dropped by the chip, frame without header is an error
+    sim->stats.frames++;
+    sim->data = true;
+    if (sim->bitCount < ID_BITS || ((sim->mode == ID_WRITE || sim->mode == ID_READ) && sim->bitCount < DATA_OFFSET))
+        sim->stats.errors++;
+}
+
+void HT1621SimPinSck(HT1621Sim_st *sim, bool level)
+{
+    // data is latched on the rising edge
+    if (level && !sim->sck && !sim->cs)
+        simBit(sim, sim->mosi);
+    sim->sck = level;
+}
+
+void HT1621SimPinMosi(HT1621Sim_st *sim, bool level)
+{
+    sim->mosi = level;
+}
+
+void HT1621SimPinRd(HT1621Sim_st *sim, bool level)
+{
+    // next data bit is driven on the falling edge
+    if (!level && sim->rd && !sim->cs)
+    {
+        if (sim->mode != ID_READ || sim->bitCount < DATA_OFFSET || !sim->dataIn)
+        {
+            sim->stats.errors++;
+        }
+        else
+        {
+            uint8_t k = (sim->bitCount++ - DATA_OFFSET) % NIBBLE_BITS;
+
+            sim->stats.bits++;
+            sim->data = (sim->ram[sim->addr] >> k) & 1;
+            if (k == NIBBLE_BITS - 1)
+            {
+                sim->addr = (sim->addr + 1) % HT1620_RAM_SIZE;
+                sim->stats.reads++;
+            }
+        }
+    }
+    sim->rd = level;
+}
+
+void HT1621SimPinDataDir(HT1621Sim_st *sim, bool input)
+{
+    sim->dataIn = input;
+}
+
+bool HT1621SimPinData(const HT1621Sim_st *sim)
+{
+    return sim->cs || sim->mode != ID_READ || sim->data;
+}
+
+void HT1621SimFlip(HT1621Sim_st *sim, uint8_t addr, uint8_t mask)
+{
+    sim->ram[addr % HT1620_RAM_SIZE] ^= mask & 0x0F;
+}
+
+void HT1621SimTransmit(HT1621Sim_st *sim, const uint8_t *data, uint8_t size, uint16_t bits)
+{
+    // SPI clocks out whole bytes, LSB first: the padding past bits reaches the chip too
+    bool selected = !sim->cs;
+
+    (void)bits;
+    if (!selected)
+        HT1621SimPinCs(sim, false); // chip select driven by the SPI peripheral
+
+    for (uint16_t n = 0; n < size * 8U; n++)
+        simBit(sim, (data[n / 8] >> (n % 8)) & 1);
+
+    if (!selected)
+        HT1621SimPinCs(sim, true);
+}
+
+/**
+ * @brief HAL BINDING BLOCK
+ *
+ * HAL hooks take no context: every slot gets its own set of functions
+ */
+static void simSck(uint8_t slot, bool level)
+{
+    for (uint8_t i = 0; i < HT1621_SIM_MAX; i++)
+    {
+        HT1621Sim_st *sim = bound[i];
+        if (sim && (i == slot || (sim->bus && sim->bus == bound[slot]->bus)))
+            HT1621SimPinSck(sim, level);
+    }
+}
+
+static void simMosi(uint8_t slot, bool level)
+{
+    for (uint8_t i = 0; i < HT1621_SIM_MAX; i++)
+    {
+        HT1621Sim_st *sim = bound[i];
+        if (sim && (i == slot || (sim->bus && sim->bus == bound[slot]->bus)))
+            HT1621SimPinMosi(sim, level);
+    }
+}
+
+static void simRd(uint8_t slot, bool level)
+{
+    for (uint8_t i = 0; i < HT1621_SIM_MAX; i++)
+    {
+        HT1621Sim_st *sim = bound[i];
+        if (sim && (i == slot || (sim->bus && sim->bus == bound[slot]->bus)))
+            HT1621SimPinRd(sim, level);
+    }
+}
+
+static void simDataDir(uint8_t slot, bool input)
+{
+    for (uint8_t i = 0; i < HT1621_SIM_MAX; i++)
+    {
+        HT1621Sim_st *sim = bound[i];
+        if (sim && (i == slot || (sim->bus && sim->bus == bound[slot]->bus)))
+            HT1621SimPinDataDir(sim, input);
+    }
+}
+
+static bool simData(uint8_t slot)
+{
+    // open drain line: any chip on it may pull it low
+    bool level = true;
+
+    for (uint8_t i = 0; i < HT1621_SIM_MAX; i++)
+    {
+        HT1621Sim_st *sim = bound[i];
+        if (sim && (i == slot || (sim->bus && sim->bus == bound[slot]->bus)))
+            level &= HT1621SimPinData(sim);
+    }
+
+    return level;
+}
+
+#define SIM_SLOT(N)                                                              \
+    static void pinCs##N(bool level)                                             \
+    {                                                                            \
+        bound[N]->stats.pinCalls++;                                              \
+        HT1621SimPinCs(bound[N], level);                                         \
+    }                                                                            \
+    static void pinSck##N(bool level)                                            \
+    {                                                                            \
+        bound[N]->stats.pinCalls++;                                              \
+        simSck(N, level);                                                        \
+    }                                                                            \
+    static void pinMosi##N(bool level)                                           \
+    {                                                                            \
+        bound[N]->stats.pinCalls++;                                              \
+        simMosi(N, level);                                                       \
+    }                                                                            \
+    static void transmit##N(const uint8_t *data, uint8_t size, uint16_t bits)    \
+    {                                                                            \
+        bound[N]->stats.pinCalls++;                                              \
+        HT1621SimTransmit(bound[N], data, size, bits);                           \
+    }                                                                            \
+    static void pinRd##N(bool level)                                             \
+    {                                                                            \
+        bound[N]->stats.pinCalls++;                                              \
+        simRd(N, level);                                                         \
+    }                                                                            \
+    static bool pinData##N(void)                                                 \
+    {                                                                            \
+        bound[N]->stats.pinCalls++;                                              \
+        return simData(N);                                                       \
+    }                                                                            \
+    static void pinDataDir##N(bool input)                                        \
+    {                                                                            \
+        bound[N]->stats.pinCalls++;                                              \
+        simDataDir(N, input);                                                    \
+    }
+
+SIM_SLOT(0)
+SIM_SLOT(1)
+SIM_SLOT(2)
+SIM_SLOT(3)
+
+#define SIM_HAL(N) {.PinCs = pinCs##N, .PinSck = pinSck##N, .PinMosi = pinMosi##N, .Transmit = transmit##N, \
+                    .PinRd = pinRd##N, .PinData = pinData##N, .PinDataDir = pinDataDir##N}
+
+static const HT1620_HAL_st slotHal[HT1621_SIM_MAX] = {SIM_HAL(0), SIM_HAL(1), SIM_HAL(2), SIM_HAL(3)};
+
+bool HT1621SimBind(HT1621Sim_st *sim, HT1620_HAL_st *hal, bool transmit)
+{
+    for (uint8_t i = 0; i < HT1621_SIM_MAX; i++)
+    {
+        if (bound[i] && bound[i] != sim)
+            continue;
+
+        bound[i] = sim;
+        hal->PinCs = slotHal[i].PinCs;
+        hal->PinSck = transmit ? 0 : slotHal[i].PinSck;
+        hal->PinMosi = transmit ? 0 : slotHal[i].PinMosi;
+        hal->Transmit = transmit ? slotHal[i].Transmit : 0;
+        // readback needs bit level pins
+        hal->PinRd = transmit ? 0 : slotHal[i].PinRd;
+        hal->PinData = transmit ? 0 : slotHal[i].PinData;
+        hal->PinDataDir = transmit ? 0 : slotHal[i].PinDataDir;
+        return true;
+    }
+
+    return false;
+}
+
+void HT1621SimUnbind(HT1621Sim_st *sim)
+{
+    for (uint8_t i = 0; i < HT1621_SIM_MAX; i++)
+    {
+        if (bound[i] == sim)
+            bound[i] = 0;
+    }
+}
+
+/**
+ * @brief RENDER BLOCK
+ */
+void HT1621SimToBuffer(const HT1621Sim_st *sim, uint8_t *buffer)
+{
+    memset(buffer, 0, DISPLAY_BUFFER_SIZE);
+
+    for (uint8_t a = 0; a < HT1620_RAM_SIZE; a++)
+    {
+        for (uint8_t k = 0; k < NIBBLE_BITS; k++)
+        {
+            uint16_t n = DATA_OFFSET + a * NIBBLE_BITS + k;
+            if ((sim->ram[a] >> k) & 1)
+                buffer[n / 8] |= 1 << (n % 8);
+        }
+    }
+}
+
+// segment code of the digit as in README.md: 10 A, 20 B, 40 C, 08 D, 04 E, 01 F, 02 G
+static uint8_t digitCode(const uint8_t *buffer, uint8_t pos)
+{
+    uint8_t fge = buffer[NUM1FGE_POS + pos];
+    uint8_t abcd = buffer[NUM1ABCD_POS + pos];
+
+    return ((fge & NUM1FGE_SEG) >> 5) | ((abcd & NUM1ABC_SEG) << 4) | (abcd & NUM1D_SEG);
+}
+
+static char lit(const uint8_t *buffer, uint8_t pos, uint8_t seg, char c)
+{
+    return (buffer[pos] & seg) ? c : ' ';
+}
+
+static void simBorder(FILE *out)
+{
+    fputc('+', out);
+    for (uint8_t i = 0; i < DISPLAY_SIZE * DIGIT_WIDTH + 2; i++)
+        fputc('-', out);
+    fputs("+\n", out);
+}
+
+void HT1621SimRender(const HT1621Sim_st *sim, FILE *out)
+{
+    uint8_t buffer[DISPLAY_BUFFER_SIZE];
+    char line[3][DISPLAY_SIZE * DIGIT_WIDTH + 1];
+
+    HT1621SimToBuffer(sim, buffer);
+    if (!sim->sysEnabled || !sim->lcdOn)
+        memset(buffer, 0, sizeof(buffer));
+
+    for (uint8_t i = 0; i < DISPLAY_SIZE; i++)
+    {
+        uint8_t code = digitCode(buffer, i);
+        char *top = &line[0][i * DIGIT_WIDTH];
+        char *mid = &line[1][i * DIGIT_WIDTH];
+        char *bot = &line[2][i * DIGIT_WIDTH];
+
+        top[0] = ' ';
+        top[1] = (code & 0x10) ? '_' : ' ';
+        top[2] = ' ';
+        top[3] = ' ';
+        mid[0] = (code & 0x01) ? '|' : ' ';
+        mid[1] = (code & 0x02) ? '_' : ' ';
+        mid[2] = (code & 0x20) ? '|' : ' ';
+        mid[3] = ' ';
+        bot[0] = (code & 0x04) ? '|' : ' ';
+        bot[1] = (code & 0x08) ? '_' : ' ';
+        bot[2] = (code & 0x40) ? '|' : ' ';
+        bot[3] = (i < DOTS_COUNT) ? lit(buffer, P1_POS + i, P1_SEG, '.') : ' ';
+    }
+
+    simBorder(out);
+    for (uint8_t l = 0; l < 3; l++)
+    {
+        line[l][DISPLAY_SIZE * DIGIT_WIDTH] = 0;
+        fprintf(out, "| %s |\n", line[l]);
+    }
+
+    simBorder(out);
+
+    fprintf(out, "BAT[%c%c%c%c] SIG[%c%c%c]",
+            lit(buffer, BAT14_POS, BAT4_SEG, '|'),
+            lit(buffer, BAT23_POS, BAT3_SEG, '#'),
+            lit(buffer, BAT23_POS, BAT2_SEG, '#'),
+            lit(buffer, BAT14_POS, BAT1_SEG, '#'),
+            lit(buffer, SIG1_POS, SIG1_SEG, '.'),
+            lit(buffer, SIG2_POS, SIG2_SEG, 'i'),
+            lit(buffer, SIG3_POS, SIG3_SEG, 'I'));
+    for (size_t i = 0; i < ICONS_COUNT; i++)
+    {
+        if (buffer[icons[i].pos] & icons[i].seg)
+            fprintf(out, " %s", icons[i].name);
+    }
+    fputs("\n", out);
+}
+
+void HT1621SimDump(const HT1621Sim_st *sim, FILE *out)
+{
+    fputs("RAM", out);
+    for (uint8_t a = 0; a < HT1620_RAM_SIZE; a++)
+        fprintf(out, "%s%X", (a % 8) ? "" : " ", sim->ram[a]);
+    fprintf(out, "\nsys %s, lcd %s, bias 0x%02X\n",
+            sim->sysEnabled ? "on" : "off", sim->lcdOn ? "on" : "off", sim->bias);
+    fprintf(out, "frames %lu, bits %lu, writes %lu, reads %lu, commands %lu, HAL calls %lu, errors %lu\n",
+            (unsigned long)sim->stats.frames, (unsigned long)sim->stats.bits,
+            (unsigned long)sim->stats.writes, (unsigned long)sim->stats.reads, (unsigned long)sim->stats.commands,
+            (unsigned long)sim->stats.pinCalls, (unsigned long)sim->stats.errors);
+}
@@ -0,0 +1,111 @@
+/*******************************************************************************
+Virtual HT1621 for host builds.
+
+Decodes the bus driven by the library, bit level pins or whole frame Transmit()
+calls, into the 32x4 display RAM and the command state of the chip, and renders
+the glass as ASCII art. Answers RAM reads on RD/DATA. Counts bus cost on the way.
+*******************************************************************************/
+
+#ifndef HT1621_SIM_H
+#define HT1621_SIM_H
+
+#include "HT1620.h"
+#include <stdio.h>
+
+#define HT1621_SIM_MAX 4 // simulators that may be bound to a HAL at once
+
+typedef struct
+{
+    uint32_t frames;   // chip select cycles
+    uint32_t bits;     // bits clocked in (WR) and out (RD) while selected
+    uint32_t writes;   // RAM addresses written
+    uint32_t reads;    // RAM addresses read
+    uint32_t commands; // commands executed
+    uint32_t pinCalls; // HAL calls: pins and Transmit()
+    uint32_t errors;   // unknown IDs, truncated headers and commands, reads into a DATA output
+} HT1621Sim_Stats_st;
+
+typedef struct
+{
+    uint8_t ram[HT1620_RAM_SIZE]; // 4 bits per address
+    bool sysEnabled;              // system oscillator
+    bool lcdOn;                   // bias generator
+    uint8_t bias;                 // last BIAS command, 0 if none
+    HT1621Sim_Stats_st stats;
+    /**
+     * Simulators with the same not 0 bus number share SCK and MOSI:
+     * every one of them sees the clock, only the selected one takes the bits
+     */
+    uint8_t bus;
+
+    // bus decoder state
+    bool cs;
+    bool sck;
+    bool mosi;
+    bool rd;
+    bool data;         // DATA driven by the chip in read mode
+    bool dataIn;       // DATA pin of the MCU switched to input
+    uint16_t bitCount; // bits of the current frame
+    uint16_t shift;    // bits collected for the current field
+    uint8_t mode;      // ID of the current frame
+    uint8_t addr;      // next RAM address of a write or read
+} HT1621Sim_st;
+
+/**
+ * @brief Power up state: RAM content 0, system and LCD off
+ */
+void HT1621SimReset(HT1621Sim_st *sim);
+
+/**
+ * @brief Fill hal with pins of the simulator
+ *
+ * @param transmit - bind Transmit() instead of PinSck/PinMosi
+ * @return false when HT1621_SIM_MAX simulators are bound already
+ */
+bool HT1621SimBind(HT1621Sim_st *sim, HT1620_HAL_st *hal, bool transmit);
+
+/**
+ * @brief Free the slot of the simulator. HAL bound to it must not be used any more
+ */
+void HT1621SimUnbind(HT1621Sim_st *sim);
+
+/**
+ * @brief Bus inputs of the chip. HT1621SimBind() routes the HAL here
+ */
+void HT1621SimPinCs(HT1621Sim_st *sim, bool level);
+void HT1621SimPinSck(HT1621Sim_st *sim, bool level);
+void HT1621SimPinMosi(HT1621Sim_st *sim, bool level);
+void HT1621SimTransmit(HT1621Sim_st *sim, const uint8_t *data, uint8_t size, uint16_t bits);
+void HT1621SimPinRd(HT1621Sim_st *sim, bool level);
+
+/**
+ * @brief Direction of the MCU DATA pin. Chip driving DATA against an output is a bus error
+ */
+void HT1621SimPinDataDir(HT1621Sim_st *sim, bool input);
+
+/**
+ * @brief DATA output of the chip: RAM bit of a read, high otherwise (released line)
+ */
+bool HT1621SimPinData(const HT1621Sim_st *sim);
+
+/**
+ * @brief Corrupt RAM like an ESD hit would: bits of mask are inverted at address addr
+ */
+void HT1621SimFlip(HT1621Sim_st *sim, uint8_t addr, uint8_t mask);
+
+/**
+ * @brief Display buffer that would give the current RAM content, in the layout of HT1620_layout.h
+ */
+void HT1621SimToBuffer(const HT1621Sim_st *sim, uint8_t *buffer);
+
+/**
+ * @brief Draw the glass: digits, dots and every lit icon. Blank while the LCD is off
+ */
+void HT1621SimRender(const HT1621Sim_st *sim, FILE *out);
+
+/**
+ * @brief Print RAM content, command state and bus statistics
+ */
+void HT1621SimDump(const HT1621Sim_st *sim, FILE *out);
+
+#endif //HT1621_SIM_H
@@ -0,0 +1,766 @@
+/*******************************************************************************
+Host demo of the library on the virtual HT1621.
+
+Runs the same script over bit level pins and over Transmit(), draws the glass
+after every step and checks that the chip RAM matches the display buffer, then
+checks a few calls against RAM contents written out from the glass pin table. The
+script ends with a chip reset recovered by HT1620Refresh() and, over pins, with
+bit flips repaired by HT1620Scrub(). Then drives two
+displays sharing SCK/MOSI in asynchronous mode and draws frames while the
+previous one is sent over an emulated DMA transport.
+Built with HT1620_STATS, library counters are printed and checked against
+the chip side ones. Built with HT1620_ENERGY, charge of every step is printed
+and meter UI designs are compared by uAh per day. With HT1620_FRAME_CACHE_SIZE
+a screen carousel is replayed from the cache. With HT1620_UPDATE_QUEUE_LEN
+posted updates are flushed at once.
+Exit code is not 0 if any check fails.
+*******************************************************************************/
+
+#include "ht1621_sim.h"
+#include <stddef.h>
+#include <string.h>
+
+#define FRAME_BITS (HT1620_RAM_SIZE * 4)
+#define FRAME_OFFSET 9 // write ID and start address precede RAM content in the buffer
+
+static int failures;
+static uint32_t busTimeNs; // emulated clock: sum of bus delays
+
+static void delayNs(uint32_t ns)
+{
+    busTimeNs += ns;
+}
+
+static uint32_t timestamp()
+{
+    return busTimeNs;
+}
+
+#ifdef HT1620_STATS
+static void stats(const char *step, HT1620_ctx *ctx, const HT1621Sim_st *sim)
+{
+    const HT1620_Stats_st *st = HT1620GetStats(ctx);
+
+    printf("library: frames %lu, bits %lu, commands %lu, flushes %lu (%lu without changes), %lu addresses skipped\n",
+           (unsigned long)st->frames, (unsigned long)st->bits, (unsigned long)st->commands,
+           (unsigned long)st->flushes, (unsigned long)st->flushesSkipped, (unsigned long)st->addrSkipped);
+    if (st->addrScrubbed)
+        printf("scrub: %lu addresses read, %lu repaired\n", (unsigned long)st->addrScrubbed, (unsigned long)st->addrRepaired);
+    printf("flush time, ns:");
+    for (uint8_t i = 0; i < HT1620_STATS_BUCKETS; i++)
+    {
+        if (st->flushTime[i])
+            printf(" <%lu: %lu", 1UL << i, (unsigned long)st->flushTime[i]);
+    }
+    printf("\n");
+
+    if (st->frames != sim->stats.frames || st->bits != sim->stats.bits || st->commands != sim->stats.commands)
+    {
+        printf("FAIL %s: library counters differ from the chip\n", step);
+        failures++;
+    }
+    HT1620ResetStats(ctx);
+}
+#endif
+
+static void checkFrame(const char *step, const uint8_t *expected, const HT1621Sim_st *sim)
+{
+    uint8_t glass[DISPLAY_BUFFER_SIZE];
+
+    HT1621SimToBuffer(sim, glass);
+    for (uint16_t n = FRAME_OFFSET; n < FRAME_OFFSET + FRAME_BITS; n++)
+    {
+        if (((glass[n / 8] ^ expected[n / 8]) >> (n % 8)) & 1)
+        {
+            printf("FAIL %s: RAM address %u differs from the buffer\n", step, (n - FRAME_OFFSET) / 4);
+            failures++;
+            return;
+        }
+    }
+    if (sim->stats.errors)
+    {
+        printf("FAIL %s: %lu bus errors\n", step, (unsigned long)sim->stats.errors);
+        failures++;
+    }
+}
+
+static void check(const char *step, const HT1620_ctx *ctx, const HT1621Sim_st *sim)
+{
+    uint8_t expected[DISPLAY_BUFFER_SIZE];
+
+    // blinking segments are hidden in the off phase
+    for (uint8_t i = 0; i < DISPLAY_BUFFER_SIZE; i++)
+        expected[i] = ctx->buffer[i] & (ctx->blink.off ? ~ctx->blink.mask[i] : 0xFF);
+
+    checkFrame(step, expected, sim);
+}
+
+// scrolling changes nothing on the glass but the digit segments and what shares them
+static void scrollKept(const char *step, const uint8_t *before, const HT1621Sim_st *sim)
+{
+    static HT1620_ctx eights;
+    HT1620_HAL_st none = {0};
+    uint8_t glass[DISPLAY_BUFFER_SIZE];
+
+    // every segment of every digit, drawn without a bus
+    HT1620Init(&eights, &none);
+    HT1620printStr(&eights, "888888888");
+
+    HT1621SimToBuffer(sim, glass);
+    for (uint16_t n = FRAME_OFFSET; n < FRAME_OFFSET + FRAME_BITS; n++)
+    {
+        if ((((glass[n / 8] ^ before[n / 8]) & ~eights.buffer[n / 8]) >> (n % 8)) & 1)
+        {
+            printf("FAIL %s: RAM address %u changed outside the digits\n", step, (n - FRAME_OFFSET) / 4);
+            failures++;
+            return;
+        }
+    }
+}
+
+// powered up chip bound to a new display on the emulated clock, false when no simulator slot is left
+static bool demoOpen(const char *name, HT1620_ctx *lcd, HT1621Sim_st *sim, HT1620_HAL_st *hal, bool transmit)
+{
+    HT1621SimReset(sim);
+    if (!HT1621SimBind(sim, hal, transmit))
+    {
+        printf("FAIL %s: no free simulator slot\n", name);
+        failures++;
+        return false;
+    }
+    hal->DelayNs = delayNs;
+    hal->Timestamp = timestamp;
+    HT1620Init(lcd, hal);
+
+    return true;
+}
+
+#ifdef HT1620_ENERGY
+#define PC_PER_UAH 3.6e9
+
+// Timestamp() of the demo counts nanoseconds
+static const HT1620_Energy_st energyModel = {
+    .EdgePc = 60,
+    .CommandPc = 200,
+    .LcdOnNa = 150000,
+    .TimestampNs = 1,
+};
+
+static void charge(HT1620_ctx *ctx)
+{
+    const HT1620_Charge_st *c = HT1620GetCharge(ctx);
+
+    printf("charge, nC: bus %.2f, commands %.2f, lcd on %.2f\n",
+           c->busPc / 1000.0, c->commandPc / 1000.0, c->lcdOnPc / 1000.0);
+    HT1620ResetCharge(ctx);
+}
+
+typedef struct
+{
+    const char *name;
+    uint16_t valuePeriod; // seconds between value updates
+    bool warnBlink;       // WARN blinks at 0.5 Hz
+} design_st;
+
+// one emulated hour of a meter screen, scaled to a day
+static void energyDesign(const design_st *design)
+{
+    static HT1620_ctx lcd;
+    static HT1621Sim_st sim;
+    HT1620_HAL_st hal = {0};
+
+    if (!demoOpen(design->name, &lcd, &sim, &hal, false))
+        return;
+    HT1620SetEnergyModel(&lcd, &energyModel);
+    HT1620clear(&lcd);
+    if (design->warnBlink)
+    {
+        HT1620DispWarn(&lcd, true);
+        HT1620BlinkSymbols(&lcd, HT1620_SYM(HT1620_SYM_WARN), 0);
+    }
+    HT1620ResetCharge(&lcd);
+
+    for (uint16_t t = 0; t < 3600; t++)
+    {
+        if (t % design->valuePeriod == 0)
+            HT1620printFixed(&lcd, 123456 + t, 1000);
+        if (design->warnBlink)
+            HT1620BlinkTick(&lcd);
+        busTimeNs += 1000000000UL; // one second, Timestamp() wraps in between calls only once
+        HT1620GetCharge(&lcd);
+    }
+
+    const HT1620_Charge_st *c = HT1620GetCharge(&lcd);
+    printf("%-36s bus %8.3f uAh/day, commands %6.3f uAh/day, lcd on %8.1f uAh/day\n", design->name,
+           c->busPc * 24 / PC_PER_UAH, c->commandPc * 24 / PC_PER_UAH, c->lcdOnPc * 24 / PC_PER_UAH);
+    HT1621SimUnbind(&sim);
+}
+
+static void energyBudget()
+{
+    static const design_st designs[] = {
+        {"value every minute", 60, false},
+        {"value every second", 1, false},
+        {"value every minute, WARN blinking", 60, true},
+    };
+
+    printf("==== energy per day, bit level pins ====\n\n");
+    for (size_t i = 0; i < sizeof(designs) / sizeof(designs[0]); i++)
+        energyDesign(&designs[i]);
+    printf("\n");
+}
+#endif
+
+static void show(const char *step, HT1620_ctx *ctx, HT1621Sim_st *sim)
+{
+    printf("%s\n", step);
+    HT1621SimRender(sim, stdout);
+    HT1621SimDump(sim, stdout);
+#ifdef HT1620_STATS
+    stats(step, ctx, sim);
+#endif
+#ifdef HT1620_ENERGY
+    charge(ctx);
+#endif
+    printf("\n");
+    check(step, ctx, sim);
+    memset(&sim->stats, 0, sizeof(sim->stats));
+}
+
+static void script(bool transmit)
+{
+    static HT1620_ctx lcd;
+    static HT1621Sim_st sim;
+    HT1620_HAL_st hal = {0};
+
+    printf("==== %s ====\n\n", transmit ? "Transmit()" : "bit level pins");
+    if (!demoOpen("script", &lcd, &sim, &hal, transmit))
+        return;
+#ifdef HT1620_ENERGY
+    HT1620SetEnergyModel(&lcd, &energyModel);
+#endif
+    HT1620clear(&lcd);
+    show("init", &lcd, &sim);
+
+    HT1620printNum(&lcd, -12345);
+    show("printNum(-12345)", &lcd, &sim);
+
+    HT1620printFloat(&lcd, 3.14159f, 3);
+    show("printFloat(3.14159, 3)", &lcd, &sim);
+
+    HT1620printStr(&lcd, "HELLO");
+    show("printStr(HELLO)", &lcd, &sim);
+
+    HT1620BeginUpdate(&lcd);
+    HT1620batteryLevel(&lcd, 60);
+    HT1620SignalLevel(&lcd, 100);
+    HT1620DispWarn(&lcd, true);
+    HT1620DispFlowM3(&lcd, true, true, true);
+    HT1620DispMinMax(&lcd, true, true, false);
+    HT1620SetSymbols(&lcd, HT1620_SYM(HT1620_SYM_LEAK_EN) | HT1620_SYM(HT1620_SYM_NBIOT), HT1620_SYM(HT1620_SYM_MAGNET));
+    HT1620printFixed(&lcd, 12345, 100);
+    HT1620Commit(&lcd);
+    show("icons, SetSymbols, printFixed(12345, 100)", &lcd, &sim);
+
+    // icons stay, every step rewrites digit addresses only
+    uint8_t before[DISPLAY_BUFFER_SIZE];
+    HT1621SimToBuffer(&sim, before);
+    HT1620Scroll(&lcd, "SN 20261017-0042", 2);
+    scrollKept("Scroll(SN 20261017-0042, 2)", before, &sim);
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        HT1620ScrollTick(&lcd);
+        scrollKept("ScrollTick()", before, &sim);
+    }
+    show("Scroll(SN 20261017-0042, 2), 8 ticks", &lcd, &sim);
+
+    // edited digit and WARN blink, phases rewrite only their addresses
+    HT1620printNum(&lcd, 2026);
+    show("printNum(2026)", &lcd, &sim);
+    HT1620BlinkSymbols(&lcd, HT1620_SYM(HT1620_SYM_WARN), 0);
+    HT1620BlinkDigits(&lcd, 1 << 5);
+    HT1620BlinkTick(&lcd);
+    show("blink WARN and digit 5: off phase", &lcd, &sim);
+    HT1620BlinkTick(&lcd);
+    show("on phase", &lcd, &sim);
+    HT1620BlinkTick(&lcd);
+    HT1620BlinkSymbols(&lcd, 0, HT1620_SYM(HT1620_SYM_WARN));
+    HT1620BlinkDigits(&lcd, 0);
+    HT1620BlinkTick(&lcd);
+    show("blink stopped in the off phase", &lcd, &sim);
+
+#ifdef HT1620_UPDATE_QUEUE_LEN
+    // pulse counter ISR posts every count, radio task the signal level and an icon: one flush for all
+    for (int32_t i = 0; i < 10; i++)
+        HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_FIXED, .value = 12340 + i, .arg = 100});
+    HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_SIGNAL, .value = 30});
+    HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_SYMBOLS, .on = HT1620_SYM(HT1620_SYM_LEAK_RU)});
+    if (HT1620FlushUpdates(&lcd) != 12)
+    {
+        printf("FAIL posted updates: not all of them were taken\n");
+        failures++;
+    }
+    show("12 posted updates, HT1620FlushUpdates()", &lcd, &sim);
+
+    // radio task forces the full signal icon, then the level drops to 0: posting order holds
+    uint8_t direct[DISPLAY_BUFFER_SIZE];
+    HT1620SetSymbols(&lcd, HT1620_SYM(HT1620_SYM_SIG3), 0);
+    HT1620SignalLevel(&lcd, 0);
+    memcpy(direct, lcd.buffer, sizeof(direct));
+    HT1620SignalLevel(&lcd, 100);
+    HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_SYMBOLS, .on = HT1620_SYM(HT1620_SYM_SIG3)});
+    HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_SIGNAL, .value = 0});
+    HT1620FlushUpdates(&lcd);
+    if (memcmp(direct, lcd.buffer, sizeof(direct)))
+    {
+        printf("FAIL posted updates: symbol change posted before the level won\n");
+        failures++;
+    }
+
+    // months of posting later the positions wrap: move them just below the wrap point
+    uint_least32_t wrapPos = (uint_least32_t)UINT32_MAX - 2;
+    for (uint32_t i = 0; i < HT1620_UPDATE_QUEUE_LEN; i++)
+        atomic_store(&lcd.updates.cell[(wrapPos + i) % HT1620_UPDATE_QUEUE_LEN].seq, wrapPos + i);
+    atomic_store(&lcd.updates.tail, wrapPos);
+    lcd.updates.head = wrapPos;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        bool posted = HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_NUM, .value = i}) &&
+                      HT1620Post(&lcd, &(HT1620_Update_st){.op = HT1620_UPD_NUM, .value = i});
+        if (!posted || HT1620FlushUpdates(&lcd) != 2)
+        {
+            printf("FAIL posted updates: queue stuck at the position wrap\n");
+            failures++;
+            break;
+        }
+    }
+#endif
+
+    HT1620displayOff(&lcd);
+    show("displayOff", &lcd, &sim);
+
+    HT1620displayOn(&lcd);
+    show("displayOn", &lcd, &sim);
+
+    // ESD hit: the chip lost its RAM and configuration, flushes alone would not notice
+    HT1621SimReset(&sim);
+    memset(sim.ram, 0x0F, sizeof(sim.ram));
+    HT1620printNum(&lcd, 123);
+    HT1620Refresh(&lcd);
+    show("chip reset, printNum(123), Refresh", &lcd, &sim);
+
+    // readback needs bit level pins
+    if (transmit)
+        return;
+
+    // ESD flipped a few bits: scrubbing one chunk at a time finds and rewrites only them
+    uint8_t found = 0;
+    HT1621SimFlip(&sim, 3, 0x05);
+    HT1621SimFlip(&sim, 20, 0x08);
+    HT1621SimFlip(&sim, 31, 0x01);
+    for (uint8_t i = 0; i < HT1620_RAM_SIZE / 8; i++)
+        found += HT1620Scrub(&lcd, 8);
+    if (found != 3)
+    {
+        printf("FAIL scrub: %u corrupted addresses found, 3 expected\n", found);
+        failures++;
+    }
+    show("3 bit flips, HT1620Scrub() over the whole RAM", &lcd, &sim);
+}
+
+/**
+ * Known answers: chip RAM after a call, written out per address (D0 = bit 0 .. D3 = bit 3)
+ * from the pin table of the glass below, not from HT1620_layout.h. A wrong segment map or a
+ * changed bit order passes the buffer checks above but fails these.
+ *
+ *   RAM address (SEG pin)    D0      D1      D2      D3
+ *   3 + 2i, digit i          F       G       E       A
+ *   4 + 2i, digit i          B       C       D       (icon)
+ *   2                                                MAX (ru)
+ *   11, 13, 15, 17, 19                               also dots P1..P5, P4 is the 2 decimals dot
+ *   21                                               m3
+ *   30                               T
+ *   31                                               WARN
+ *
+ * A of digits 4..8 and the dots share D3 of addresses 11..19. Digit 0 is the leftmost one,
+ * segments as in README.md: A top, B top right, C bottom right, D bottom, E bottom left,
+ * F top left, G middle
+ */
+typedef struct
+{
+    const char *name;
+    void (*draw)(HT1620_ctx *ctx);
+    uint8_t ram[HT1620_RAM_SIZE];
+} answer_st;
+
+static void answerNum(HT1620_ctx *ctx)
+{
+    HT1620printNum(ctx, 123456);
+}
+
+static void answerStr(HT1620_ctx *ctx)
+{
+    HT1620printStr(ctx, "HELLO");
+}
+
+static void answerFloat(HT1620_ctx *ctx)
+{
+    HT1620printFloat(ctx, -3.25f, 2);
+}
+
+static void answerSymbols(HT1620_ctx *ctx)
+{
+    HT1620SetSymbols(ctx, HT1620_SYM(HT1620_SYM_WARN) | HT1620_SYM(HT1620_SYM_M3) |
+                              HT1620_SYM(HT1620_SYM_T) | HT1620_SYM(HT1620_SYM_MAX_RU), 0);
+    HT1620Commit(ctx);
+}
+
+static const answer_st answers[] = {
+    // right aligned to 6 digits: 1 = BC, 2 = ABDEG, 3 = ABCDG, 4 = BCFG, 5 = ACDFG, 6 = ACDEFG
+    {"printNum(123456)", answerNum,
+     {[3] = 0x0, [4] = 0x3, [5] = 0xE, [6] = 0x5, [7] = 0xA, [8] = 0x7,
+      [9] = 0x3, [10] = 0x3, [11] = 0xB, [12] = 0x6, [13] = 0xF, [14] = 0x6}},
+    // left aligned: H = BCEFG, E = ADEFG, L = DEF, O = CDEG
+    {"printStr(HELLO)", answerStr,
+     {[3] = 0x7, [4] = 0x2, [5] = 0xF, [6] = 0x4, [7] = 0x5, [8] = 0x4,
+      [9] = 0x5, [10] = 0x4, [11] = 0x6, [12] = 0x6}},
+    // -325 in digits 2..5 (minus is G), the 2 decimals dot is D3 of address 17
+    {"printFloat(-3.25, 2)", answerFloat,
+     {[7] = 0x2, [9] = 0xA, [10] = 0x7, [11] = 0xE, [12] = 0x5, [13] = 0xB, [14] = 0x6, [17] = 0x8}},
+    {"SetSymbols(WARN, m3, T, MAX)", answerSymbols,
+     {[2] = 0x8, [21] = 0x8, [30] = 0x2, [31] = 0x8}},
+};
+
+#define ANSWERS_COUNT (sizeof(answers) / sizeof(answers[0]))
+
+static void knownAnswers(bool transmit)
+{
+    static HT1620_ctx lcd;
+    static HT1621Sim_st sim;
+    HT1620_HAL_st hal = {0};
+
+    printf("==== known answers, %s ====\n\n", transmit ? "Transmit()" : "bit level pins");
+    for (size_t i = 0; i < ANSWERS_COUNT; i++)
+    {
+        if (!demoOpen(answers[i].name, &lcd, &sim, &hal, transmit))
+            return;
+        HT1620clear(&lcd);
+        answers[i].draw(&lcd);
+
+        printf("%s\n", answers[i].name);
+        HT1621SimDump(&sim, stdout);
+        for (uint8_t a = 0; a < HT1620_RAM_SIZE; a++)
+        {
+            if (sim.ram[a] != answers[i].ram[a])
+            {
+                printf("FAIL %s: RAM address %u is %X, %X expected\n", answers[i].name, a, sim.ram[a], answers[i].ram[a]);
+                failures++;
+            }
+        }
+        HT1621SimUnbind(&sim);
+    }
+    printf("\n");
+}
+
+// only icon segments of the frame at offset from may change, every other byte of the context stays
+static void symbolsCheck(const char *step, const HT1620_ctx *before, const HT1620_ctx *after, const uint8_t *icons,
+                         size_t from)
+{
+    const uint8_t *b = (const uint8_t *)before;
+    const uint8_t *a = (const uint8_t *)after;
+
+    for (size_t i = 0; i < sizeof(HT1620_ctx); i++)
+    {
+        uint8_t allowed = (i >= from && i < from + DISPLAY_BUFFER_SIZE) ? icons[i - from] : 0;
+        if ((a[i] ^ b[i]) & ~allowed)
+        {
+            printf("FAIL %s: byte %u of the context changed outside the icon segments\n", step, (unsigned)i);
+            failures++;
+            return;
+        }
+    }
+}
+
+// whole masks, bits past HT1620_SYM_COUNT included, switch icons and nothing else
+static void symbolMasks()
+{
+    static HT1620_ctx lcd, before;
+    static HT1621Sim_st sim;
+    HT1620_HAL_st hal = {0};
+    uint8_t icons[DISPLAY_BUFFER_SIZE];
+
+    if (!demoOpen("symbol masks", &lcd, &sim, &hal, true))
+        return;
+
+    memset(lcd.buffer, 0, sizeof(lcd.buffer));
+    HT1620SetSymbols(&lcd, HT1620_SYM(HT1620_SYM_COUNT) - 1, 0);
+    memcpy(icons, lcd.buffer, sizeof(icons));
+
+    HT1620printNum(&lcd, -123456);
+    before = lcd;
+    HT1620SetSymbols(&lcd, ~0ULL, 0);
+    symbolsCheck("SetSymbols(~0, 0)", &before, &lcd, icons, offsetof(HT1620_ctx, buffer));
+
+    before = lcd;
+    HT1620SetSymbols(&lcd, 0, ~0ULL);
+    symbolsCheck("SetSymbols(0, ~0)", &before, &lcd, icons, offsetof(HT1620_ctx, buffer));
+
+    before = lcd;
+    HT1620BlinkSymbols(&lcd, ~0ULL, 0);
+    symbolsCheck("BlinkSymbols(~0, 0)", &before, &lcd, icons, offsetof(HT1620_ctx, blink.mask));
+    HT1621SimUnbind(&sim);
+}
+
+#ifdef HT1620_FRAME_CACHE_SIZE
+enum
+{
+    SCREEN_ENERGY,
+    SCREEN_FLOW,
+    SCREEN_TEMP,
+    SCREENS_COUNT
+};
+
+static void screenRender(HT1620_ctx *lcd, uint16_t screen, int32_t value)
+{
+    HT1620BeginUpdate(lcd);
+    HT1620DispEnergyJ(lcd, screen == SCREEN_ENERGY, true, false);
+    HT1620DispFlowM3(lcd, screen == SCREEN_FLOW, true, true);
+    HT1620DispT(lcd, screen == SCREEN_TEMP);
+    HT1620printFixed(lcd, value, 100);
+    HT1620Commit(lcd);
+}
+
+// carousel of three screens: only the first round is rendered, later ones are cache hits
+static void cachedCarousel()
+{
+    static HT1620_ctx lcd;
+    static HT1621Sim_st sim;
+    HT1620_HAL_st hal = {0};
+    uint8_t hits = 0;
+
+    printf("==== cached carousel ====\n\n");
+    if (!demoOpen("cached carousel", &lcd, &sim, &hal, false))
+        return;
+
+    for (uint8_t round = 0; round < 4; round++)
+    {
+        for (uint16_t screen = 0; screen < SCREENS_COUNT; screen++)
+        {
+            int32_t value = 4200 + screen * 111;
+
+            if (HT1620CacheShow(&lcd, screen, value))
+            {
+                hits++;
+            }
+            else
+            {
+                screenRender(&lcd, screen, value);
+                HT1620CacheStore(&lcd, screen, value);
+            }
+            check("cached carousel", &lcd, &sim);
+        }
+    }
+
+    show("temperature screen from the cache", &lcd, &sim);
+    if (hits != 3 * SCREENS_COUNT)
+    {
+        printf("FAIL cached carousel: %u hits, %u expected\n", hits, 3 * SCREENS_COUNT);
+        failures++;
+    }
+    HT1621SimUnbind(&sim);
+}
+#endif
+
+static void pageTemperature(HT1620_ctx *ctx, void *arg)
+{
+    HT1620DispT(ctx, true);
+    HT1620printNum(ctx, *(const int32_t *)arg);
+}
+
+// a rendered page and a ready frame page, every tick checked against the chip
+static void pageCarousel()
+{
+    static HT1620_ctx lcd;
+    static HT1621Sim_st sim;
+    static uint8_t frame[DISPLAY_BUFFER_SIZE];
+    static const int32_t temperature = 21;
+    HT1620_HAL_st hal = {0};
+
+    printf("==== page carousel ====\n\n");
+    if (!demoOpen("page carousel", &lcd, &sim, &hal, false))
+        return;
+
+    // frame of the second page is prepared once
+    HT1620BeginUpdate(&lcd);
+    HT1620clear(&lcd);
+    HT1620printStr(&lcd, "SERIAL");
+    HT1620DispSN(&lcd, true, false);
+    memcpy(frame, lcd.buffer, sizeof(frame));
+    HT1620Commit(&lcd);
+
+    const HT1620_Page_st pages[] = {
+        {.render = pageTemperature, .arg = (void *)&temperature, .dwell = 2},
+        {.frame = frame, .dwell = 3},
+    };
+
+    HT1620Carousel(&lcd, pages, 2);
+    for (uint8_t t = 0; t < 7; t++)
+    {
+        HT1620CarouselTick(&lcd);
+        check("page carousel", &lcd, &sim);
+    }
+    show("7 ticks: serial page again", &lcd, &sim);
+    HT1620CarouselStop(&lcd);
+    HT1621SimUnbind(&sim);
+}
+
+// DMA transport: TransmitAsync() starts a transfer, the demo plays the DMA complete interrupt
+static struct
+{
+    HT1620_ctx *ctx;
+    void (*transmit)(const uint8_t *data, uint8_t size, uint16_t bits); // simulator end of the transfer
+    const uint8_t *data;                                                // transfer in progress, 0 if none
+    uint8_t size;
+    uint16_t bits;
+    bool deferred; // false: the transfer ends inside TransmitAsync()
+    uint8_t flushes;
+} dma;
+
+static void dmaInterrupt()
+{
+    const uint8_t *data = dma.data;
+
+    dma.data = NULL;
+    dma.transmit(data, dma.size, dma.bits);
+    HT1620TransmitDone(dma.ctx);
+}
+
+static void dmaStart(const uint8_t *data, uint8_t size, uint16_t bits)
+{
+    dma.data = data;
+    dma.size = size;
+    dma.bits = bits;
+    if (!dma.deferred)
+        dmaInterrupt();
+}
+
+static void dmaFlushed(HT1620_ctx *ctx)
+{
+    (void)ctx;
+    dma.flushes++;
+}
+
+// frames are drawn into the buffer while the previous one is on the bus
+static void dmaFrames()
+{
+    static HT1620_ctx lcd;
+    static HT1621Sim_st sim;
+    uint8_t front[DISPLAY_BUFFER_SIZE];
+    HT1620_HAL_st hal = {0};
+    uint8_t transfers = 0;
+
+    printf("==== DMA, double buffered ====\n\n");
+    if (!demoOpen("DMA", &lcd, &sim, &hal, true))
+        return;
+
+    // the display started over the bound Transmit(), from here on frames go through the DMA
+    dma.ctx = &lcd;
+    dma.transmit = hal.Transmit;
+    hal.Transmit = NULL;
+    hal.TransmitAsync = dmaStart;
+
+    // blocking mode waits for the interrupt
+    HT1620printStr(&lcd, "DMA");
+    show("blocking flush over TransmitAsync()", &lcd, &sim);
+
+    // the update stays open: prints only draw, HT1620FlushAsync() hands frames over
+    dma.deferred = true;
+    HT1620BeginUpdate(&lcd);
+    HT1620clear(&lcd);
+    HT1620printNum(&lcd, 1000);
+    HT1620batteryLevel(&lcd, 100);
+    memcpy(front, lcd.buffer, sizeof(front));
+    if (!HT1620FlushAsync(&lcd, dmaFlushed) || !dma.data)
+    {
+        printf("FAIL DMA: flush did not start a transfer\n");
+        failures++;
+    }
+
+    HT1620printNum(&lcd, 1001);
+    HT1620batteryLevel(&lcd, 75);
+    while (dma.data)
+    {
+        dmaInterrupt();
+        transfers++;
+    }
+    printf("first frame: %u transfers, drawn over while sent\n", transfers);
+    HT1621SimRender(&sim, stdout);
+    printf("\n");
+    checkFrame("DMA first frame", front, &sim);
+
+    HT1620FlushAsync(&lcd, dmaFlushed);
+    while (dma.data)
+        dmaInterrupt();
+    HT1620Commit(&lcd);
+    show("second frame", &lcd, &sim);
+    if (dma.flushes != 2 || HT1620Busy(&lcd))
+    {
+        printf("FAIL DMA: %u flush callbacks, 2 expected\n", dma.flushes);
+        failures++;
+    }
+    HT1621SimUnbind(&sim);
+}
+
+static void sharedBus()
+{
+    static HT1620_ctx lcd[2];
+    static HT1621Sim_st sim[2];
+    static HT1620_Bus_st bus;
+    HT1620_HAL_st hal[2] = {{0}, {0}};
+
+    printf("==== two displays, shared bus, asynchronous ====\n\n");
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        sim[i].bus = 1;
+        HT1621SimReset(&sim[i]);
+        HT1621SimBind(&sim[i], &hal[i], false);
+        hal[i].Bus = &bus;
+        hal[i].DelayNs = delayNs;
+        hal[i].Timestamp = timestamp;
+        HT1620Init(&lcd[i], &hal[i]);
+        HT1620SetAsync(&lcd[i], true, 0);
+    }
+
+    HT1620printNum(&lcd[0], 111111);
+    HT1620printStr(&lcd[1], "SHARED");
+    HT1620DispT(&lcd[1], true);
+    HT1620Commit(&lcd[1]);
+
+    // the same tick drives both, bus is taken by whoever gets it first
+    while (HT1620Tick(&lcd[0], 3) | HT1620Tick(&lcd[1], 5))
+        ;
+
+    show("display 0", &lcd[0], &sim[0]);
+    show("display 1", &lcd[1], &sim[1]);
+}
+
+int main()
+{
+    script(false);
+    script(true);
+    knownAnswers(false);
+    knownAnswers(true);
+    symbolMasks();
+    sharedBus();
+    dmaFrames();
+    pageCarousel();
+#ifdef HT1620_FRAME_CACHE_SIZE
+    cachedCarousel();
+#endif
+#ifdef HT1620_ENERGY
+    energyBudget();
+#endif
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -30,23 +30,34 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 *******************************************************************************/
 
 #include "HT1620.h"
-#include "main.h"
-#include <math.h>
-#include <stdio.h>
+#include "HT1620_format.h"
+#include "HT1620_layout.h"
 #include <string.h>
 
 /**
  * @brief CALCULATION DEFINES BLOCK
  */
-#define MAX_NUM 999999999
-#define MIN_NUM -999999999
-
 #define PRECISION_MAX_POSITIVE 5 // TODO: find better names
 #define PRECISION_MAX_NEGATIVE 5
 #define PRECISION_MIN 1
 
+/**
+ * @brief IEEE-754 SINGLE PRECISION FIELDS
+ */
+#define FLOAT_SIGN (1UL << 31)
+#define FLOAT_MANT_BITS 23
+#define FLOAT_EXP_MASK 0xFF
+#define FLOAT_EXP_BIAS 127
+#define FLOAT_BITS_1E8 0x4CBEBC20UL // 100000000.0f, nearest float to -MIN_NUM / 10
+
+#define PRINT_NUM_WIDTH 6 // numbers are right aligned to this width, longer ones take more digits
+
 #define BITS_PER_BYTE 8
 
+#ifndef HT1620_CPU_HZ
+#define HT1620_CPU_HZ 72000000UL // core clock the busy wait without DelayNs is sized for
+#endif
+
 #ifndef MIN
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 #define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
@@ -57,636 +68,1499 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #endif //SET_BIT
 
 #ifndef CLEAR_BIT
-#define CLEAR_BIT(REG, BIT) ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT) ((REG) &= ~(BIT))
 #endif //CLEAR_BIT
 
-uint8_t buffer[DISPLAY_BUFFER_SIZE] = {0}; // buffer where display data will be stored
+/**
+ * @brief DISPLAY HARDWARE DEFINES BLOCK
+ */
+#define MODE_CMD 0x04 //0b100 command mode, followed by any number of 9 bit commands
+#define CMD_BITS 9
+#define MODE_DATA 0x05 //0b101 successive address write
+#define MODE_READ 0x06 //0b110 successive address read, DATA is driven by the chip on RD falling edge
+
+/**
+ * @brief DISPLAY RAM DEFINES BLOCK
+ *
+ * buffer holds the write frame in transmission order: bit n of the bitstream is
+ * bit (n % 8) of buffer[n / 8]. Bits 0..8 are the write ID and the start address,
+ * RAM address a takes bits 9 + 4a (D0) up to 12 + 4a (D3).
+ */
+#define RAM_SIZE HT1620_RAM_SIZE // HT1621 RAM: 32 addresses of 4 bits
+#define RAM_ALL_DIRTY 0xFFFFFFFFUL
+#define NIBBLE_BITS 4
+#define ID_BITS 3
+#define ADDR_BITS 6
+#define DATA_OFFSET (ID_BITS + ADDR_BITS) // bitstream position of address 0, D0
+#define CMDS_PER_FRAME ((DISPLAY_BUFFER_SIZE * BITS_PER_BYTE - ID_BITS) / CMD_BITS)
+
+/**
+ * @brief BUS TIMING BLOCK
+ *
+ * Minimal values from the HT1621 datasheet AC characteristics, see HT1620.h
+ */
+const HT1620_Timing_st HT1620_TIMING_3V = {
+    .ClkLowNs = HT1620_3V_CLK_NS,
+    .ClkHighNs = HT1620_3V_CLK_NS,
+    .SetupNs = HT1620_SETUP_NS,
+    .HoldNs = HT1620_HOLD_NS,
+    .CsSetupNs = HT1620_CS_SETUP_NS,
+    .CsHoldNs = HT1620_CS_HOLD_NS,
+    .CsHighNs = HT1620_CS_HIGH_NS,
+    .RdLowNs = HT1620_3V_RD_NS,
+    .RdHighNs = HT1620_3V_RD_NS,
+};
+
+const HT1620_Timing_st HT1620_TIMING_5V = {
+    .ClkLowNs = HT1620_5V_CLK_NS,
+    .ClkHighNs = HT1620_5V_CLK_NS,
+    .SetupNs = HT1620_SETUP_NS,
+    .HoldNs = HT1620_HOLD_NS,
+    .CsSetupNs = HT1620_CS_SETUP_NS,
+    .CsHoldNs = HT1620_CS_HOLD_NS,
+    .CsHighNs = HT1620_CS_HIGH_NS,
+    .RdLowNs = HT1620_5V_RD_NS,
+    .RdHighNs = HT1620_5V_RD_NS,
+};
+
+// write ID and start address in transmission order: ID 101, then A5..A0
+#define ADDR_REVERSED(A) ((((A) & 0x01) << 5) | (((A) & 0x02) << 3) | (((A) & 0x04) << 1) | \
+                          (((A) & 0x08) >> 1) | (((A) & 0x10) >> 3) | (((A) & 0x20) >> 5))
+#define WR_HEADER(A) (MODE_DATA | (ADDR_REVERSED(A) << ID_BITS))
+#define WR_HEADER4(A) WR_HEADER(A), WR_HEADER((A) + 1), WR_HEADER((A) + 2), WR_HEADER((A) + 3)
+
+static const uint16_t wrHeader[RAM_SIZE] = {
+    WR_HEADER4(0), WR_HEADER4(4), WR_HEADER4(8), WR_HEADER4(12),
+    WR_HEADER4(16), WR_HEADER4(20), WR_HEADER4(24), WR_HEADER4(28),
+};
+
+// Cost of starting one more successive write (ID, address and chip select cycle)
+// in clock periods. Unchanged addresses cheaper than that are rewritten instead.
+#define RUN_SPLIT_COST (DATA_OFFSET + 2)
+
+/**
+ * @brief STATISTICS BLOCK
+ */
+#ifdef HT1620_STATS
+#define STATS_ADD(FIELD, N) (ctx->stats.FIELD += (N))
+#else
+#define STATS_ADD(FIELD, N) ((void)(N))
+#endif
 
-#define LCD_SWITCH(EN, POS, SEG) ((EN) ? (SET_BIT(buffer[POS], SEG)) : (CLEAR_BIT(buffer[POS], SEG)))
-//#define LCD_TOGGLE(EN, POS1, SEG1, POS2, SEG2) ((EN) ? ({SET_BIT(buffer[POS1], SEG1); CLEAR_BIT(buffer[POS2], SEG2); }) : ({SET_BIT(buffer[POS2], SEG2); CLEAR_BIT(buffer[POS1], SEG1); }))
-inline void LCD_TOGGLE(bool EN, uint8_t POS1, uint8_t SEG1, uint8_t POS2, uint8_t SEG2)
+/**
+ * @brief ENERGY BLOCK
+ */
+#ifdef HT1620_ENERGY
+#define ENERGY_ADD(FIELD, N, UNIT) (ctx->charge.FIELD += (uint64_t)(N) * ctx->energy->UNIT)
+
+const HT1620_Energy_st HT1620_ENERGY_3V = {
+    .EdgePc = 60,         // 20 pF * 3 V
+    .CommandPc = 200,     // command decoding, rough
+    .LcdOnNa = 150000,    // datasheet IDD, 3 V, on-chip RC oscillator, no load
+    .TimestampNs = 1000,
+};
+#else
+#define ENERGY_ADD(FIELD, N, UNIT) ((void)(N))
+#endif
+
+typedef struct
 {
-    if (EN)
+    uint8_t fge;  // NUM1FGE_POS byte part of the digit
+    uint8_t abcd; // NUM1ABCD_POS byte part of the digit
+} glyph_st;
+
+// Symbol in ascii table format (see README.md) split into its two digit position bytes.
+// 02345678 conversion to 67805234: shift 5 for FGE, shift 4 for ABC, D is not shifted
+#define GLYPH(CODE) {NUM1FGE_SEG & ((CODE) << 5), (NUM1ABC_SEG & ((CODE) >> 4)) | (NUM1D_SEG & (CODE))}
+
+// Printable part of ascii, from ' ' to '_'. Lower case letters are shown as upper case ones
+static const glyph_st glyphs[] =
     {
-        SET_BIT(buffer[POS1], SEG1);
-        CLEAR_BIT(buffer[POS2], SEG2);
+        /*       ' '          ' '          ' '          ' '          ' '          ' '          ' '          ' '    */
+        /*2*/ GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00),
+        /*       ' '          ' '          ' '          ' '          ' '          '-'          ' '          ' '    */
+        /*2*/ GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x02), GLYPH(0x00), GLYPH(0x00),
+        /*       '0'          '1'          '2'          '3'          '4'          '5'          '6'          '7'    */
+        /*3*/ GLYPH(0x7D), GLYPH(0x60), GLYPH(0x3e), GLYPH(0x7a), GLYPH(0x63), GLYPH(0x5b), GLYPH(0x5f), GLYPH(0x70),
+        /*       '8'          '9'          ' '          ' '          ' '          ' '          ' '          ' '    */
+        /*3*/ GLYPH(0x7f), GLYPH(0x7b), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00),
+        /*       ' '          'A'          'B'          'C'          'D'          'E'          'F'          'G'    */
+        /*4*/ GLYPH(0x00), GLYPH(0x77), GLYPH(0x4f), GLYPH(0x1d), GLYPH(0x6e), GLYPH(0x1f), GLYPH(0x17), GLYPH(0x5d),
+        /*       'H'          'I'          'J'          'K'          'L'          'M'          'N'          'O'    */
+        /*4*/ GLYPH(0x47), GLYPH(0x05), GLYPH(0x68), GLYPH(0x27), GLYPH(0x0d), GLYPH(0x54), GLYPH(0x75), GLYPH(0x4e),
+        /*       'P'          'Q'          'R'          'S'          'T'          'U'          'V'          'W'    */
+        /*5*/ GLYPH(0x37), GLYPH(0x73), GLYPH(0x06), GLYPH(0x59), GLYPH(0x0f), GLYPH(0x6d), GLYPH(0x23), GLYPH(0x29),
+        /*       'X'          'Y'          'Z'          ' '          ' '          ' '          ' '          '_'    */
+        /*5*/ GLYPH(0x67), GLYPH(0x6b), GLYPH(0x3c), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x00), GLYPH(0x08),
+};
+
+#define GLYPHS_COUNT (sizeof(glyphs) / sizeof(glyphs[0]))
+
+typedef struct
+{
+    uint8_t pos;
+    uint8_t seg;
+} symbol_st;
+
+#define SYMBOL(NAME) [HT1620_SYM_##NAME] = {NAME##_POS, NAME##_SEG}
+#define SYM(NAME) HT1620_SYM(HT1620_SYM_##NAME)
+// segments drawn by HT1620batteryLevel() and HT1620SignalLevel()
+#define BATTERY_SYMBOLS (SYM(BAT1) | SYM(BAT2) | SYM(BAT3) | SYM(BAT4))
+#define SIGNAL_SYMBOLS (SYM(SIG1) | SYM(SIG2) | SYM(SIG3))
+
+// where every HT1620_Symbol_e icon is in the buffer
+static const symbol_st symbols[HT1620_SYM_COUNT] = {
+    SYMBOL(MIN_RU), SYMBOL(MAX_RU), SYMBOL(MIN_EN), SYMBOL(MAX_EN),
+    SYMBOL(BURST_RU), SYMBOL(BURST_EN), SYMBOL(LEAK_RU), SYMBOL(LEAK_EN),
+    SYMBOL(REV_RU), SYMBOL(REV_EN), SYMBOL(FROST), SYMBOL(Q),
+    SYMBOL(VER_RU), SYMBOL(VER_EN), SYMBOL(SN_RU), SYMBOL(SN_EN),
+    SYMBOL(WARN), SYMBOL(MAGNET), SYMBOL(LEFT), SYMBOL(RIGHT),
+    SYMBOL(NOWATER), SYMBOL(CRC), SYMBOL(DELTA), SYMBOL(T),
+    SYMBOL(T1), SYMBOL(T2), SYMBOL(NBFI), SYMBOL(NBIOT),
+    SYMBOL(DEGREE), SYMBOL(GCAL), SYMBOL(GCAL_H), SYMBOL(GJ),
+    SYMBOL(GJ_H), SYMBOL(KW), SYMBOL(MW), SYMBOL(W),
+    SYMBOL(WH), SYMBOL(GAL), SYMBOL(GAL_PM), SYMBOL(M3),
+    SYMBOL(M3_H), SYMBOL(M3_H_EN), SYMBOL(FT3), SYMBOL(FT3_PM),
+    SYMBOL(MMBTU), SYMBOL(GALLONS), SYMBOL(US),
+    [HT1620_SYM_BAT1] = {BAT14_POS, BAT1_SEG},
+    [HT1620_SYM_BAT2] = {BAT23_POS, BAT2_SEG},
+    [HT1620_SYM_BAT3] = {BAT23_POS, BAT3_SEG},
+    [HT1620_SYM_BAT4] = {BAT14_POS, BAT4_SEG},
+    SYMBOL(SIG1), SYMBOL(SIG2), SYMBOL(SIG3),
+};
+
+#define ASCII_SPACE_SYMBOL 0x00
+
+// two decimal digits of 0..99 as BCD
+#define DIGIT_PAIRS(T) (T << 4), (T << 4) | 1, (T << 4) | 2, (T << 4) | 3, (T << 4) | 4, \
+                       (T << 4) | 5, (T << 4) | 6, (T << 4) | 7, (T << 4) | 8, (T << 4) | 9
+
+static const uint8_t digitPairs[100] = {
+    DIGIT_PAIRS(0), DIGIT_PAIRS(1), DIGIT_PAIRS(2), DIGIT_PAIRS(3), DIGIT_PAIRS(4),
+    DIGIT_PAIRS(5), DIGIT_PAIRS(6), DIGIT_PAIRS(7), DIGIT_PAIRS(8), DIGIT_PAIRS(9),
+};
+
+static const uint32_t powersOf10[PRECISION_MAX_POSITIVE + 1] = {1, 10, 100, 1000, 10000, 100000};
+
+// V / 100 by reciprocal multiplication, exact for any 32 bit V
+#define DIV100(V) ((uint32_t)(((uint64_t)(V) * 0x51EB851FULL) >> 37))
+
+// precompute bus delays for the selected timing profile
+static void busDelayUpdate(HT1620_ctx *ctx);
+// other display on the shared bus is in the middle of its frame
+static bool busTaken(HT1620_ctx *ctx);
+// the most low-level function. Makes next bus edge of the head frame, returns delay to keep after it
+static HT1620_Delay_e txStep(HT1620_ctx *ctx);
+// get free frame at the queue tail. Waits for the bus when queue is full
+static HT1620_TxFrame_st *txAlloc(HT1620_ctx *ctx);
+// queue the frame got from txAlloc(ctx). Blocking mode sends it right away
+static void txPush(HT1620_ctx *ctx, uint16_t bits);
+// send all queued frames
+static void txDrain(HT1620_ctx *ctx);
+// end a queue change, starting the bus when the DMA transport waits for it
+static void txUnlock(HT1620_ctx *ctx);
+// move queued frames to the DMA transport until one is in flight
+static void txKick(HT1620_ctx *ctx);
+// write changed part of the buffer to the display
+void wrBuffer(HT1620_ctx *ctx);
+// queue the changed part of the buffer even inside an update, caller holds the queue lock
+static void wrQueue(HT1620_ctx *ctx);
+// queue the part of frame that differs from the driver RAM, or keep frame for a retry when the queue is full
+static void wrFrame(HT1620_ctx *ctx, const uint8_t *frame);
+// flush duration measurement, no-ops without HT1620_STATS
+static void statsFlushBegin(HT1620_ctx *ctx);
+static void statsFlushEnd(HT1620_ctx *ctx);
+// account LCD on time up to now, no-op without HT1620_ENERGY
+static void energyLcdUpdate(HT1620_ctx *ctx);
+// take the shared bus, finishing the frame of its owner first
+static void busAcquire(HT1620_ctx *ctx);
+// read count successive RAM addresses starting from start, one nibble per address
+static void rdRun(HT1620_ctx *ctx, uint8_t start, uint8_t count, uint8_t *nibbles);
+// get content of RAM address addr from the buffer bitstream
+static uint8_t frameNibble(const uint8_t *frame, uint8_t addr);
+// write count successive RAM addresses of frame starting from start
+static void wrRun(HT1620_ctx *ctx, const uint8_t *frame, uint8_t start, uint8_t count);
+// last address of the write that starts at dirty address start
+static uint8_t runEnd(uint32_t dirty, uint8_t start);
+// mask of RAM addresses that differ between two buffers
+static uint32_t frameDiff(const uint8_t *frame, const uint8_t *other);
+// get byte of the buffer bitstream continued past the end of RAM
+static uint8_t frameByte(const uint8_t *frame, uint8_t i);
+// put count bits of value into the bitstream at position n, most significant first
+static uint16_t frameBitsPut(uint8_t *frame, uint16_t n, uint16_t value, uint8_t count);
+// set decimal separator. Used when print float numbers
+void decimalSeparator(HT1620_ctx *ctx, uint8_t dpPosition);
+// takes the buffer and puts it straight into the driver
+void update(HT1620_ctx *ctx);
+// remove battery symbol from display buffer
+void batteryBufferClear(HT1620_ctx *ctx);
+// remove dot symbol from display buffer
+void dotsBufferClear(HT1620_ctx *ctx);
+// remove all symbols from display buffer except battery and dots
+void lettersBufferClear(HT1620_ctx *ctx);
+//Clear all segments
+void AllClear(HT1620_ctx *ctx);
+// get glyph of the character, not displayable characters are shown as space
+static const glyph_st *glyphOf(char c);
+// put glyph into digit position pos
+static void glyphPut(uint8_t *out, uint8_t pos, const glyph_st *glyph);
+// show icons of on, hide icons of off in frame
+static void symbolsApply(uint8_t *frame, uint64_t on, uint64_t off);
+// check whether any segment blinks
+static bool blinkAny(HT1620_ctx *ctx);
+// draw the text window of the scroll step into the digits
+static void scrollDraw(HT1620_ctx *ctx);
+// draw the current carousel page and flush it
+static void pageShow(HT1620_ctx *ctx);
+#ifdef HT1620_UPDATE_QUEUE_LEN
+// mark every cell of the update ring free for the first round
+static void updatesInit(HT1620_ctx *ctx);
+#endif
+
+void HT1620Init(HT1620_ctx *ctx, const HT1620_HAL_st *hal_ptr)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->hal = hal_ptr;
+    ctx->timing = &HT1620_TIMING_3V;
+    busDelayUpdate(ctx);
+#ifdef HT1620_ENERGY
+    ctx->energy = &HT1620_ENERGY_3V;
+#endif
+#ifdef HT1620_UPDATE_QUEUE_LEN
+    updatesInit(ctx);
+#endif
+    // driver RAM content is unknown after power up
+    ctx->ramDirty = RAM_ALL_DIRTY;
+
+    static const uint8_t init[] = {
+        HT1620_CMD_BIAS,
+        HT1620_CMD_SYSDIS,
+        HT1620_CMD_WDTDIS1,
+        HT1620_CMD_SYSEN,
+        HT1620_CMD_LCDON,
+        HT1620_CMD_BIAS,
+    };
+
+    HT1620WriteCmds(ctx, init, sizeof(init));
+    energyLcdUpdate(ctx);
+    ctx->lcdOn = true;
+}
+
+void HT1620SetTiming(HT1620_ctx *ctx, const HT1620_Timing_st *timing)
+{
+    ctx->timing = timing;
+    busDelayUpdate(ctx);
+}
+
+static void busDelayUpdate(HT1620_ctx *ctx)
+{
+    uint32_t *ns = ctx->busDelay.ns;
+
+    ns[HT1620_DELAY_NONE] = 0;
+    ns[HT1620_DELAY_CLK_LOW] = MAX(ctx->timing->ClkLowNs, ctx->timing->SetupNs);
+    ns[HT1620_DELAY_CLK_HIGH] = MAX(ctx->timing->ClkHighNs, ctx->timing->HoldNs);
+    ns[HT1620_DELAY_CLK_HIGH_LAST] = MAX(ns[HT1620_DELAY_CLK_HIGH], ctx->timing->CsHoldNs);
+    ns[HT1620_DELAY_CS_SETUP] = ctx->timing->CsSetupNs;
+    ns[HT1620_DELAY_CS_HOLD] = ctx->timing->CsHoldNs;
+    ns[HT1620_DELAY_CS_HIGH] = ctx->timing->CsHighNs;
+    ns[HT1620_DELAY_RD_LOW] = ctx->timing->RdLowNs;
+    ns[HT1620_DELAY_RD_HIGH] = ctx->timing->RdHighNs;
+
+    // every round of the busy wait takes at least one core cycle, so it waits at least ns
+    // on cores up to HT1620_CPU_HZ. Divided here once, the bus edges only count down
+    for (uint8_t i = 0; i < HT1620_DELAY_COUNT; i++)
+        ctx->busDelay.loops[i] = (uint32_t)(((uint64_t)ns[i] * (HT1620_CPU_HZ / 1000000UL) + 999) / 1000);
+}
+
+static inline void busDelay(HT1620_ctx *ctx, HT1620_Delay_e delay)
+{
+    if (ctx->hal->DelayNs)
+    {
+        ctx->hal->DelayNs(ctx->busDelay.ns[delay]);
+        return;
     }
+
+    volatile uint32_t loops = ctx->busDelay.loops[delay];
+    while (loops)
+        loops--;
+}
+
+void HT1620displayOn(HT1620_ctx *ctx)
+{
+    static const uint8_t on[] = {HT1620_CMD_SYSEN, HT1620_CMD_LCDON};
+
+    HT1620WriteCmds(ctx, on, sizeof(on));
+    energyLcdUpdate(ctx);
+    ctx->lcdOn = true;
+}
+
+void HT1620displayOff(HT1620_ctx *ctx)
+{
+    // oscillator is not needed without bias generator: stop both
+    static const uint8_t off[] = {HT1620_CMD_LCDOFF, HT1620_CMD_SYSDIS};
+
+    HT1620WriteCmds(ctx, off, sizeof(off));
+    energyLcdUpdate(ctx);
+    ctx->lcdOn = false;
+}
+
+void HT1620Refresh(HT1620_ctx *ctx)
+{
+    static const uint8_t on[] = {HT1620_CMD_BIAS, HT1620_CMD_WDTDIS1, HT1620_CMD_SYSEN, HT1620_CMD_LCDON};
+    static const uint8_t off[] = {HT1620_CMD_BIAS, HT1620_CMD_WDTDIS1, HT1620_CMD_LCDOFF, HT1620_CMD_SYSDIS};
+
+    if (ctx->lcdOn)
+        HT1620WriteCmds(ctx, on, sizeof(on));
     else
+        HT1620WriteCmds(ctx, off, sizeof(off));
+
+    ctx->ramDirty = RAM_ALL_DIRTY;
+    wrBuffer(ctx);
+}
+
+void HT1620SetAsync(HT1620_ctx *ctx, bool enable, void (*done)(HT1620_ctx *ctx))
+{
+    if (!enable && ctx->tx.async)
     {
-        SET_BIT(buffer[POS2], SEG2);
-        CLEAR_BIT(buffer[POS1], SEG1);
+        ctx->tx.lock++;
+        txDrain(ctx);
+        ctx->tx.async = false;
+
+        // the flush postponed by a full queue goes out as well
+        if (ctx->tx.flushPending)
+        {
+            ctx->tx.flushPending = false;
+            wrFrame(ctx, ctx->tx.front);
+        }
+        ctx->tx.lock--;
     }
+
+    ctx->tx.async = enable;
+    ctx->tx.done = done;
 }
-/**
- * @brief DISPLAY HARDWARE DEFINES BLOCK
- */
-#define BIAS 0x52    //0b1000 0101 0010  1/3duty 4com
-#define SYSDIS 0x00  //0b1000 0000 0000  Turn off both system oscillator and LCD bias generator
-#define SYSEN 0x02   //0b1000 0000 0010  Turn on system oscillator
-#define LCDOFF 0x04  //0b1000 0000 0100  Turn off LCD bias generator
-#define LCDON 0x06   //0b1000 0000 0110  Turn on LCD bias generator
-#define XTAL 0x28    //0b1000 0010 1000  System clock source, crystal oscillator
-#define RC256 0x30   //0b1000 0011 0000  System clock source, on-chip RC oscillator
-#define TONEON 0x12  //0b1000 0001 0010  Turn on tone outputs
-#define TONEOFF 0x10 //0b1000 0001 0000  Turn off tone outputs
-#define WDTDIS1 0x0A //0b1000 0000 1010  Disable WDT time-out flag output
-#define CLRTMR 0x1A //0b1000 0000 1010  Disable WDT time-out flag output
-
-#define MODE_CMD 0x08
-#define MODE_DATA 0x05
-
-#define ADR0_SHIFT 0
-#define ADR1_SHIFT 7
-
-#define BAT1_SEG (1 << 5)
-#define BAT2_SEG (1 << 1)
-#define BAT3_SEG (1 << 2)
-#define BAT4_SEG (1 << 6)
-
-#define BAT14_POS 13
-#define BAT23_POS 14
-
-#define P1_SEG (1 << 0)
-#define P1_POS 7
-#define P2_SEG (1 << 0)
-#define P2_POS 8
-#define P3_SEG (1 << 0)
-#define P3_POS 9
-#define P4_SEG (1 << 0)
-#define P4_POS 10
-#define P5_SEG (1 << 0)
-#define P5_POS 11
-
-#define NUM1FGE_SEG (7 << 5) //0b11100000
-#define NUM1FGE_POS 2
-#define NUM1ABC_SEG (0x7 << 0) //0b00000111
-#define NUM1D_SEG (0x08 << 0)  //0b00001000
-#define NUM1ABCD_POS 3
-
-#define MINUS_SEG (1 << 0)
-#define MINUS_POS 4
-
-#define MIN_RU_SEG (1 << 0)
-#define MIN_RU_POS 5
-#define MAX_RU_SEG (1 << 4)
-#define MAX_RU_POS 2
-
-#define MIN_EN_SEG (1 << 0)
-#define MIN_EN_POS 6
-#define MAX_EN_SEG (1 << 0)
-#define MAX_EN_POS 3
-
-#define BURST_RU_SEG (1 << 4)
-#define BURST_RU_POS 1
-#define BURST_EN_SEG (1 << 7)
-#define BURST_EN_POS 1
-
-#define LEAK_RU_SEG (1 << 6)
-#define LEAK_RU_POS 1
-#define LEAK_EN_SEG (1 << 3)
-#define LEAK_EN_POS 1
-
-#define REV_RU_SEG (1 << 2)
-#define REV_RU_POS 1
-#define REV_EN_SEG (1 << 1)
-#define REV_EN_POS 1
-
-#define FROST_SEG (1 << 0)
-#define FROST_POS 2
-
-#define Q_SEG (1 << 3)
-#define Q_POS 2
-
-#define VER_RU_SEG (1 << 1)
-#define VER_RU_POS 2
-#define VER_EN_SEG (1 << 2)
-#define VER_EN_POS 2
-
-#define SN_RU_SEG (1 << 5)
-#define SN_RU_POS 1
-#define SN_EN_SEG (1 << 7)
-#define SN_EN_POS 16
-
-#define WARN_SEG (1 << 0)
-#define WARN_POS 17
-
-#define MAGNET_SEG (1 << 4)
-#define MAGNET_POS 16
-
-#define LEFT_SEG (1 << 0)
-#define LEFT_POS 16
-
-#define RIGHT_SEG (1 << 0)
-#define RIGHT_POS 15
-
-#define NOWATER_SEG (1 << 4)
-#define NOWATER_POS 15
-
-#define CRC_SEG (1 << 6)
-#define CRC_POS 16
-
-#define DELTA_SEG (1 << 5)
-#define DELTA_POS 16
-
-#define T_SEG (1 << 2)
-#define T_POS 16
-
-#define T1_SEG (1 << 3)
-#define T1_POS 16
-
-#define T2_SEG (1 << 7)
-#define T2_POS 15
-
-#define NBFI_SEG (1 << 4)
-#define NBFI_POS 14
-
-#define NBIOT_SEG (1 << 0)
-#define NBIOT_POS 14
-
-#define SIG1_SEG (1 << 7)
-#define SIG1_POS 14
-#define SIG2_SEG (1 << 3)
-#define SIG2_POS 14
-#define SIG3_SEG (1 << 7)
-#define SIG3_POS 13
-
-#define DEGREE_SEG (1 << 6)
-#define DEGREE_POS 15
-
-#define GCAL_SEG (1 << 2)
-#define GCAL_POS 13
-#define GCAL_H_SEG (1 << 6)
-#define GCAL_H_POS 12
-
-#define GJ_SEG (1 << 5)
-#define GJ_POS 15
-#define GJ_H_SEG (1 << 1)
-#define GJ_H_POS 13
-
-#define KW_SEG (1 << 5)
-#define KW_POS 11
-#define MW_SEG (1 << 6)
-#define MW_POS 11
-#define W_SEG (1 << 5)
-#define W_POS 12
-#define WH_SEG (1 << 1)
-#define WH_POS 12
-
-#define GAL_SEG (1 << 2)
-#define GAL_POS 13
-#define GAL_PM_SEG (1 << 6)
-#define GAL_PM_POS 12
-
-#define M3_SEG (1 << 0)
-#define M3_POS 12
-#define M3_H_SEG (1 << 3)
-#define M3_H_POS 12
-#define M3_H_EN_SEG (1 << 4)
-#define M3_H_EN_POS 12
-
-#define FT3_SEG (1 << 2)
-#define FT3_POS 15
-#define FT3_PM_SEG (1 << 1)
-#define FT3_PM_POS 15
-
-#define MMBTU_SEG (1 << 3)
-#define MMBTU_POS 15
-
-#define GALLONS_SEG (1 << 5)
-#define GALLONS_POS 14
-#define US_SEG (1 << 6)
-#define US_POS 14
-
-#define ALL_CLEAR_SEG (0xfe << 0) //0b11111110
-#define ALL_CLEAR_POS 1
-
-#define DOT_SEG 0x80
-
-static const char ascii[] =
-    {
-        /*       0     1     2     3     4     5     6     7     8     9     a     b     c     d     e     f */
-        /*      ' '   ' '   ' '   ' '   ' '   ' '   ' '   ' '   ' '   ' '   ' '   ' '   ' '   '-'   ' '   ' ' */
-        /*2*/ 0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x02,
-        0x00,
-        0x00,
-        /*      '0'   '1'   '2'   '3'   '4'   '5'   '6'   '7'   '8'   '9'   ' '   ' '   ' '   ' '   ' '   ' ' */
-        /*3*/ 0x7D,
-        0x60,
-        0x3e,
-        0x7a,
-        0x63,
-        0x5b,
-        0x5f,
-        0x70,
-        0x7f,
-        0x7b,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        /*      ' '   'A'   'B'   'C'   'D'   'E'   'F'   'G'   'H'   'I'   'J'   'K'   'L'   'M'   'N'   'O' */
-        /*4*/ 0x00,
-        0x77,
-        0x4f,
-        0x1d,
-        0x6e,
-        0x1f,
-        0x17,
-        0x5d,
-        0x47,
-        0x05,
-        0x68,
-        0x27,
-        0x0d,
-        0x54,
-        0x75,
-        0x4e,
-        /*      'P'   'Q'   'R'   'S'   'T'   'U'   'V'   'W'   'X'   'Y'   'Z'   ' '   ' '   ' '   ' '   '_' */
-        /*5*/ 0x37,
-        0x73,
-        0x06,
-        0x59,
-        0x0f,
-        0x6d,
-        0x23,
-        0x29,
-        0x67,
-        0x6b,
-        0x3c,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x08,
-        /*      ' '   'A'   'B'   'C'   'D'   'E'   'F'   'G'   'H'   'I'   'J'   'K'   'L'   'M'   'N'   'O' */
-        /*6*/ 0x00,
-        0x77,
-        0x4f,
-        0x1d,
-        0x6e,
-        0x1f,
-        0x17,
-        0x5d,
-        0x47,
-        0x05,
-        0x68,
-        0x27,
-        0x0d,
-        0x54,
-        0x75,
-        0x4e,
-        /*      'P'   'Q'   'R'   'S'   'T'   'U'   'V'   'W'   'X'   'Y'   'Z'   ' '   ' '   ' '   ' '   ' ' */
-        /*7*/ 0x37,
-        0x73,
-        0x06,
-        0x59,
-        0x0f,
-        0x6d,
-        0x23,
-        0x29,
-        0x67,
-        0x6b,
-        0x3c,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-        0x00,
-};
 
-#define ASCII_SPACE_SYMBOL 0x00
+bool HT1620Busy(HT1620_ctx *ctx)
+{
+    return ctx->tx.count || ctx->tx.flushPending;
+}
+
+bool HT1620Tick(HT1620_ctx *ctx, uint16_t edges)
+{
+    ctx->tx.lock++;
+
+    // frame is not started while other display on the shared bus sends its own
+    while (edges-- > 0 && ctx->tx.count && !(ctx->tx.step == 0 && busTaken(ctx)))
+    {
+        HT1620_Delay_e delay = txStep(ctx);
+
+        // the tick period covers the delay after the last edge of the call only
+        if (edges > 0)
+            busDelay(ctx, delay);
+    }
+
+    if (!ctx->tx.count && ctx->tx.flushPending)
+    {
+        ctx->tx.flushPending = false;
+        wrFrame(ctx, ctx->tx.front);
+    }
+
+    txUnlock(ctx);
+    return HT1620Busy(ctx);
+}
+
+bool HT1620FlushAsync(HT1620_ctx *ctx, void (*done)(HT1620_ctx *ctx))
+{
+    ctx->tx.lock++;
+    ctx->tx.async = true;
+    ctx->tx.flushDone = done;
+    wrQueue(ctx);
+    txUnlock(ctx);
+
+    // nothing to send, or a transport that completes at once sent it already
+    if (!HT1620Busy(ctx) && ctx->tx.flushDone)
+    {
+        ctx->tx.flushDone = NULL;
+        done(ctx);
+    }
+
+    return HT1620Busy(ctx);
+}
+
+void HT1620TransmitDone(HT1620_ctx *ctx)
+{
+    // chip select hold is counted from the last clock edge, the end of the transfer
+    busDelay(ctx, HT1620_DELAY_CS_HOLD);
+    ctx->tx.dmaBusy = false;
+
+    // interrupted queue changes and blocking waits go on with the next frame themselves
+    if (ctx->tx.async && !ctx->tx.lock)
+        txKick(ctx);
+}
+
+static void txKick(HT1620_ctx *ctx)
+{
+    HT1620_Bus_st *bus = ctx->hal->Bus;
 
-#define LITTLE_ENDIAN
+    // Between DMA transfers there are only chip select edges and the retry of a postponed flush,
+    // so they are made at once. A transfer that ends while locked leaves dmaBusy clear: go on
+    do
+    {
+        ctx->tx.lock++;
+        while (ctx->tx.count && !ctx->tx.dmaBusy && !(ctx->tx.step == 0 && busTaken(ctx)))
+            busDelay(ctx, txStep(ctx));
+
+        if (!ctx->tx.count && ctx->tx.flushPending)
+        {
+            ctx->tx.flushPending = false;
+            wrFrame(ctx, ctx->tx.front);
+        }
+        ctx->tx.lock--;
+    } while (ctx->tx.count && !ctx->tx.dmaBusy && !(ctx->tx.step == 0 && busTaken(ctx)));
+
+    if (ctx->tx.count && ctx->tx.step == 0 && busTaken(ctx))
+    {
+        // the owner starts this display when its own queue runs empty
+        bus->waiting = ctx;
+    }
+    else if (!ctx->tx.count && bus && bus->waiting && bus->waiting != ctx)
+    {
+        // a locked display starts itself on unlock
+        HT1620_ctx *next = bus->waiting;
+        bus->waiting = NULL;
+        if (!next->tx.lock)
+            txKick(next);
+    }
+}
+
+static void txUnlock(HT1620_ctx *ctx)
+{
+    if (--ctx->tx.lock == 0 && ctx->tx.async && ctx->hal->TransmitAsync)
+        txKick(ctx);
+}
+
+static bool busTaken(HT1620_ctx *ctx)
+{
+    return ctx->hal->Bus && ctx->hal->Bus->owner && ctx->hal->Bus->owner != ctx;
+}
+
+static void busAcquire(HT1620_ctx *ctx)
+{
+    HT1620_Bus_st *bus = ctx->hal->Bus;
+
+    if (busTaken(ctx))
+    {
+        // blocking write can not wait for HT1620Tick() of the other display: finish its frame first
+        HT1620_ctx *owner = bus->owner;
+        while (bus->owner == owner)
+            busDelay(owner, txStep(owner));
+    }
+    if (bus)
+        bus->owner = ctx;
+}
+
+static bool txBlockTransfer(HT1620_ctx *ctx)
+{
+    // without bit level pins whole frame is a single Transmit() call (or nothing at all)
+    return ctx->hal->Transmit || ctx->hal->TransmitAsync || !ctx->hal->PinSck || !ctx->hal->PinMosi;
+}
+
+static HT1620_Delay_e txStep(HT1620_ctx *ctx)
+{
+    // HT1620TransmitDone() ends the wait
+    if (ctx->tx.dmaBusy)
+        return HT1620_DELAY_NONE;
 
-#if !defined(BIG_ENDIAN) && !defined(LITTLE_ENDIAN)
-#error "Unable to determine endian. Set it manually"
+    HT1620_TxFrame_st *frame = &ctx->tx.frame[ctx->tx.head];
+    uint16_t step = ctx->tx.step++;
+    uint16_t last = txBlockTransfer(ctx) ? 2 : frame->bits * 2 + 1;
+
+    if (step == 0)
+    {
+        busAcquire(ctx);
+        if (ctx->hal->PinCs)
+            ctx->hal->PinCs(LOW);
+        return HT1620_DELAY_CS_SETUP;
+    }
+
+    if (step == last)
+    {
+        if (ctx->hal->PinCs)
+            ctx->hal->PinCs(HIGH);
+        if (ctx->hal->Bus)
+            ctx->hal->Bus->owner = NULL;
+
+        uint16_t clocked = txBlockTransfer(ctx) ? (frame->bits + BITS_PER_BYTE - 1) / BITS_PER_BYTE * BITS_PER_BYTE : frame->bits;
+        STATS_ADD(frames, 1);
+        STATS_ADD(bits, clocked);
+        ENERGY_ADD(busPc, 2 + clocked * 2, EdgePc); // chip select and two clock edges per bit
+
+        ctx->tx.step = 0;
+        ctx->tx.head = (ctx->tx.head + 1) % HT1620_TX_QUEUE_LEN;
+        ctx->tx.count--;
+        if (!ctx->tx.count && ctx->tx.async && !ctx->tx.flushPending)
+            statsFlushEnd(ctx);
+        if (!ctx->tx.count && ctx->tx.done)
+            ctx->tx.done(ctx);
+        if (!ctx->tx.count && !ctx->tx.flushPending && ctx->tx.flushDone)
+        {
+            void (*flushDone)(HT1620_ctx *) = ctx->tx.flushDone;
+            ctx->tx.flushDone = NULL;
+            flushDone(ctx);
+        }
+        return HT1620_DELAY_CS_HIGH;
+    }
+
+    if (txBlockTransfer(ctx))
+    {
+        if (ctx->hal->TransmitAsync)
+        {
+            ctx->tx.dmaBusy = true;
+            ctx->hal->TransmitAsync(frame->data, (frame->bits + BITS_PER_BYTE - 1) / BITS_PER_BYTE, frame->bits);
+            return HT1620_DELAY_NONE;
+        }
+        if (ctx->hal->Transmit)
+            ctx->hal->Transmit(frame->data, (frame->bits + BITS_PER_BYTE - 1) / BITS_PER_BYTE, frame->bits);
+        return HT1620_DELAY_CS_HOLD;
+    }
+
+    // send bits into display one by one: data is changed on falling edge, latched on rising
+    uint16_t n = (step - 1) / 2;
+    if ((step - 1) % 2 == 0)
+    {
+        ctx->hal->PinSck(LOW);
+        ctx->hal->PinMosi((frame->data[n / BITS_PER_BYTE] >> (n % BITS_PER_BYTE)) & 1);
+        return HT1620_DELAY_CLK_LOW;
+    }
+
+    ctx->hal->PinSck(HIGH);
+    return (step + 1 == last) ? HT1620_DELAY_CLK_HIGH_LAST : HT1620_DELAY_CLK_HIGH;
+}
+
+static void txDrain(HT1620_ctx *ctx)
+{
+    // locked: the DMA interrupt only clears dmaBusy, steps are made here
+    ctx->tx.lock++;
+    while (ctx->tx.count)
+        busDelay(ctx, txStep(ctx));
+    ctx->tx.lock--;
+}
+
+static HT1620_TxFrame_st *txAlloc(HT1620_ctx *ctx)
+{
+    if (ctx->tx.count == HT1620_TX_QUEUE_LEN)
+        txDrain(ctx);
+
+    return &ctx->tx.frame[(ctx->tx.head + ctx->tx.count) % HT1620_TX_QUEUE_LEN];
+}
+
+static void txPush(HT1620_ctx *ctx, uint16_t bits)
+{
+    ctx->tx.lock++;
+    ctx->tx.frame[(ctx->tx.head + ctx->tx.count) % HT1620_TX_QUEUE_LEN].bits = bits;
+    ctx->tx.count++;
+
+    if (!ctx->tx.async)
+        txDrain(ctx);
+    txUnlock(ctx);
+}
+
+static uint32_t frameDiff(const uint8_t *frame, const uint8_t *other)
+{
+    // unchanged screen is the common case: one compare of the bytes holding whole addresses
+    if (!memcmp(frame + 2, other + 2, DISPLAY_BUFFER_SIZE - 3) &&
+        !((frame[1] ^ other[1]) & 0xFE) && !((frame[DISPLAY_BUFFER_SIZE - 1] ^ other[DISPLAY_BUFFER_SIZE - 1]) & 0x01))
+        return 0;
+
+    // byte i holds D3 of address 2i - 3 in bit 0, address 2i - 2 in bits 1..4, D0..D2 of address 2i - 1 in bits 5..7.
+    // Byte 1 starts with A0 of the header, the last byte ends with padding
+    uint32_t dirty = 0;
+    for (uint8_t i = 1; i < DISPLAY_BUFFER_SIZE; i++)
+    {
+        uint8_t diff = frame[i] ^ other[i];
+        if (!diff)
+            continue;
+
+        if ((diff & 0x01) && i > 1)
+            dirty |= 1UL << (2 * i - 3);
+        if ((diff & 0x1E) && i < DISPLAY_BUFFER_SIZE - 1)
+            dirty |= 1UL << (2 * i - 2);
+        if ((diff & 0xE0) && i < DISPLAY_BUFFER_SIZE - 1)
+            dirty |= 1UL << (2 * i - 1);
+    }
+
+    return dirty;
+}
+
+static uint8_t frameByte(const uint8_t *frame, uint8_t i)
+{
+    // Driver address wraps from 31 to 0 and RAM is exactly DATA_SIZE bytes long,
+    // so the stream goes on with the bytes of address 0 and up
+    if (i < DISPLAY_BUFFER_SIZE - 1)
+        return frame[i];
+    if (i == DISPLAY_BUFFER_SIZE - 1)
+        return (frame[i] & 0x01) | (frame[i - DATA_SIZE] & 0xFE);
+
+    return frame[i - DATA_SIZE];
+}
+
+static uint16_t frameBitsPut(uint8_t *frame, uint16_t n, uint16_t value, uint8_t count)
+{
+    while (count-- > 0)
+    {
+        if ((value >> count) & 1)
+        {
+            SET_BIT(frame[n / BITS_PER_BYTE], 1 << (n % BITS_PER_BYTE));
+        }
+        n++;
+    }
+
+    return n;
+}
+
+static uint8_t frameNibble(const uint8_t *frame, uint8_t addr)
+{
+    uint16_t n = DATA_OFFSET + addr * NIBBLE_BITS;
+    uint16_t word = frame[n / BITS_PER_BYTE] | (frame[n / BITS_PER_BYTE + 1] << BITS_PER_BYTE);
+
+    return (word >> (n % BITS_PER_BYTE)) & 0x0F;
+}
+
+static void wrRun(HT1620_ctx *ctx, const uint8_t *frame, uint8_t start, uint8_t count)
+{
+    HT1620_TxFrame_st *tx = txAlloc(ctx);
+    uint16_t bits = DATA_OFFSET + count * NIBBLE_BITS;
+    uint8_t size = (bits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+    // Frame is in transmission order already: the run is the frame shifted by its
+    // start address, padding included. Header and padding go into the copy only,
+    // the frame itself is never changed
+    uint8_t shift = (start % 2) * NIBBLE_BITS;
+    for (uint8_t k = 0; k < size; k++)
+    {
+        uint8_t i = k + start / 2;
+        tx->data[k] = (frameByte(frame, i) >> shift) | (frameByte(frame, i + 1) << (BITS_PER_BYTE - shift));
+    }
+    tx->data[0] = wrHeader[start] & 0xFF;
+    tx->data[1] = (tx->data[1] & 0xFE) | (wrHeader[start] >> BITS_PER_BYTE);
+
+    txPush(ctx, bits);
+}
+
+static uint8_t runEnd(uint32_t dirty, uint8_t start)
+{
+    // Close changes are merged into one write when resending
+    // the gap is cheaper than a new header
+    uint8_t end = start;
+    for (uint8_t next = start + 1; next < RAM_SIZE && (next - end - 1) * NIBBLE_BITS <= RUN_SPLIT_COST; next++)
+    {
+        if (dirty & (1UL << next))
+            end = next;
+    }
+
+    return end;
+}
+
+void HT1620BeginUpdate(HT1620_ctx *ctx)
+{
+    ctx->updateDepth++;
+}
+
+void HT1620Commit(HT1620_ctx *ctx)
+{
+    if (ctx->updateDepth)
+        ctx->updateDepth--;
+
+    wrBuffer(ctx);
+}
+
+void wrBuffer(HT1620_ctx *ctx)
+{
+    if (ctx->updateDepth)
+        return;
+
+    ctx->tx.lock++;
+    wrQueue(ctx);
+    txUnlock(ctx);
+}
+
+static void wrQueue(HT1620_ctx *ctx)
+{
+    uint8_t blanked[DISPLAY_BUFFER_SIZE];
+    uint8_t *frame = ctx->buffer;
+
+    // off phase of blinking: the driver gets the buffer without blinking segments
+    if (ctx->blink.off)
+    {
+        for (uint8_t i = 0; i < DISPLAY_BUFFER_SIZE; i++)
+            blanked[i] = ctx->buffer[i] & ~ctx->blink.mask[i];
+        frame = blanked;
+    }
+
+    wrFrame(ctx, frame);
+}
+
+static void wrFrame(HT1620_ctx *ctx, const uint8_t *frame)
+{
+    uint32_t dirty = ctx->ramDirty | frameDiff(frame, ctx->shadow);
+
+    if (!dirty)
+    {
+        STATS_ADD(flushesSkipped, 1);
+        return;
+    }
+
+    statsFlushBegin(ctx);
+
+    uint8_t slots = HT1620_TX_QUEUE_LEN - ctx->tx.count;
+    if (ctx->tx.async && !slots)
+    {
+        // Keep the changes, HT1620Tick() or the DMA interrupt flushes again when the queue
+        // is empty. The frame is kept as well: the buffer may be drawn over until then
+        if (frame != ctx->tx.front)
+            memcpy(ctx->tx.front, frame, sizeof(ctx->tx.front));
+        ctx->ramDirty = dirty;
+        ctx->tx.flushPending = true;
+        return;
+    }
+    // the postponed flush is part of this one
+    ctx->ramDirty = 0;
+    ctx->tx.flushPending = false;
+
+    uint8_t runs = 0;
+    for (uint8_t start = 0; start < RAM_SIZE; start++)
+    {
+        if (dirty & (1UL << start))
+        {
+            runs++;
+            start = runEnd(dirty, start);
+        }
+    }
+
+    // Send changed addresses as successive writes. If queue has no room for all of them
+    // (asynchronous mode only) everything between the first and the last change goes at once
+    uint8_t last = RAM_SIZE - 1;
+    while (!(dirty & (1UL << last)))
+        last--;
+
+    bool single = ctx->tx.async && runs > slots;
+    uint8_t sent = 0;
+    for (uint8_t start = 0; start < RAM_SIZE; start++)
+    {
+        if (!(dirty & (1UL << start)))
+            continue;
+
+        uint8_t end = single ? last : runEnd(dirty, start);
+        wrRun(ctx, frame, start, end - start + 1);
+        sent += end - start + 1;
+        start = end;
+    }
+    STATS_ADD(flushes, 1);
+    STATS_ADD(addrSkipped, RAM_SIZE - sent);
+
+    // every dirty address is queued now: the driver RAM will hold the frame as it is
+    memcpy(ctx->shadow, frame, sizeof(ctx->shadow));
+
+    if (!ctx->tx.async)
+        statsFlushEnd(ctx);
+}
+
+#ifdef HT1620_STATS
+static void statsFlushBegin(HT1620_ctx *ctx)
+{
+    // flush postponed by a full queue is timed from its first attempt
+    if (ctx->flushTimed || !ctx->hal->Timestamp)
+        return;
+
+    ctx->flushStart = ctx->hal->Timestamp();
+    ctx->flushTimed = true;
+}
+
+static void statsFlushEnd(HT1620_ctx *ctx)
+{
+    if (!ctx->flushTimed)
+        return;
+
+    uint32_t duration = ctx->hal->Timestamp() - ctx->flushStart;
+    uint8_t bucket = 0;
+    while (duration && bucket < HT1620_STATS_BUCKETS - 1)
+    {
+        duration >>= 1;
+        bucket++;
+    }
+
+    ctx->stats.flushTime[bucket]++;
+    ctx->flushTimed = false;
+}
+
+const HT1620_Stats_st *HT1620GetStats(HT1620_ctx *ctx)
+{
+    return &ctx->stats;
+}
+
+void HT1620ResetStats(HT1620_ctx *ctx)
+{
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+}
+#else
+static void statsFlushBegin(HT1620_ctx *ctx)
+{
+    (void)ctx;
+}
+
+static void statsFlushEnd(HT1620_ctx *ctx)
+{
+    (void)ctx;
+}
+#endif
+
+#ifdef HT1620_ENERGY
+void HT1620SetEnergyModel(HT1620_ctx *ctx, const HT1620_Energy_st *model)
+{
+    energyLcdUpdate(ctx);
+    ctx->energy = model;
+}
+
+static void energyLcdUpdate(HT1620_ctx *ctx)
+{
+    if (!ctx->hal->Timestamp)
+        return;
+
+    uint32_t now = ctx->hal->Timestamp();
+    if (ctx->lcdOn)
+    {
+        // pC = us * nA / 1000, no overflow for days between calls
+        uint64_t us = (uint64_t)(now - ctx->lcdOnSince) * ctx->energy->TimestampNs / 1000;
+        ctx->charge.lcdOnPc += us * ctx->energy->LcdOnNa / 1000;
+    }
+    ctx->lcdOnSince = now;
+}
+
+const HT1620_Charge_st *HT1620GetCharge(HT1620_ctx *ctx)
+{
+    energyLcdUpdate(ctx);
+    ctx->charge.totalPc = ctx->charge.busPc + ctx->charge.commandPc + ctx->charge.lcdOnPc;
+
+    return &ctx->charge;
+}
+
+void HT1620ResetCharge(HT1620_ctx *ctx)
+{
+    energyLcdUpdate(ctx);
+    memset(&ctx->charge, 0, sizeof(ctx->charge));
+}
+#else
+static void energyLcdUpdate(HT1620_ctx *ctx)
+{
+    (void)ctx;
+}
 #endif
 
-union tDataSeq
-{
-    struct //__attribute__((packed))
-    {
-#if defined LITTLE_ENDIAN
-        uint8_t padding : 7;
-        uint64_t data1 : 64;
-        uint64_t data0 : 64;
-        uint8_t addr : 6;
-        uint8_t type : 3;
-#elif defined BIG_ENDIAN
-        uint8_t type : 3;
-        uint8_t addr : 6;
-        uint16_t data0 : 16;
-        uint16_t data1 : 16;
-        uint16_t data2 : 16;
-        uint8_t padding : 7;
-#endif
-    };
-    uint8_t arr[18];
-};
+#ifdef HT1620_FRAME_CACHE_SIZE
+static HT1620_CachedFrame_st *cacheSlot(HT1620_ctx *ctx, uint16_t screen)
+{
+    // one slot per screen: a new value of the screen replaces the old one
+    return &ctx->cache[screen % HT1620_FRAME_CACHE_SIZE];
+}
 
-HT1620_HAL_st *HT1620_hal = 0;
+bool HT1620CacheShow(HT1620_ctx *ctx, uint16_t screen, int32_t value)
+{
+    const HT1620_CachedFrame_st *slot = cacheSlot(ctx, screen);
 
-inline void LCD_TOGGLE(bool EN, uint8_t POS1, uint8_t SEG1, uint8_t POS2, uint8_t SEG2);
-// the most low-level function. Sends array of bytes into display
-void wrBytes(uint8_t *ptr, uint8_t size);
-// write buffer to the display
-void wrBuffer();
-// write command sequence to display
-void wrCmd(uint8_t cmd);
-// set decimal separator. Used when print float numbers
-void decimalSeparator(uint8_t dpPosition);
-// takes the buffer and puts it straight into the driver
-void update();
-// remove battery symbol from display buffer
-void batteryBufferClear();
-// remove dot symbol from display buffer
-void dotsBufferClear();
-// remove all symbols from display buffer except battery and dots
-void lettersBufferClear();
-//Clear all segments
-void AllClear();
-// coverts buffer symbols to format, which can be displayed by lcd
-void bufferToAscii(const char *in, uint8_t *out);
+    if (!slot->valid || slot->screen != screen || slot->value != value)
+        return false;
 
-void HT1620Init(HT1620_HAL_st *hal_ptr)
-{
-    HT1620_hal = hal_ptr;
+    HT1620ScrollStop(ctx);
+    memcpy(ctx->buffer, slot->frame, sizeof(ctx->buffer));
+    wrBuffer(ctx);
 
-    wrCmd(BIAS);
-   // wrCmd(XTAL);
-    wrCmd(SYSDIS);
-    wrCmd(WDTDIS1);
-    wrCmd(SYSEN);
-    wrCmd(LCDON);
+    return true;
+}
 
-    wrCmd(BIAS);
+void HT1620CacheStore(HT1620_ctx *ctx, uint16_t screen, int32_t value)
+{
+    HT1620_CachedFrame_st *slot = cacheSlot(ctx, screen);
 
-//    wrCmd(XTAL);
-//    wrCmd(CLRTMR);
+    slot->screen = screen;
+    slot->value = value;
+    slot->valid = true;
+    memcpy(slot->frame, ctx->buffer, sizeof(slot->frame));
+}
 
-//    wrCmd(TONEOFF);
-//    wrCmd(LCDOFF);
+void HT1620CacheClear(HT1620_ctx *ctx)
+{
+    for (uint8_t i = 0; i < HT1620_FRAME_CACHE_SIZE; i++)
+        ctx->cache[i].valid = false;
 }
+#endif
+
+#ifdef HT1620_UPDATE_QUEUE_LEN
+#if HT1620_UPDATE_QUEUE_LEN & (HT1620_UPDATE_QUEUE_LEN - 1)
+#error "HT1620_UPDATE_QUEUE_LEN must be a power of 2"
+#endif
 
-void HT1620displayOn()
+static void updatesInit(HT1620_ctx *ctx)
 {
-    wrCmd(LCDON);
+    for (uint32_t i = 0; i < HT1620_UPDATE_QUEUE_LEN; i++)
+        atomic_init(&ctx->updates.cell[i].seq, i);
+    atomic_init(&ctx->updates.tail, 0);
+    ctx->updates.head = 0;
 }
 
-void HT1620displayOff()
+// moves the tail from pos to pos + 1 unless another producer did first, reloads pos like compare-and-swap
+static bool updatesClaim(HT1620_ctx *ctx, uint_least32_t *pos)
 {
-    wrCmd(LCDOFF);
+#ifdef HT1620_NO_CAS
+    bool claimed;
+
+    HT1620_CRITICAL_ENTER();
+    uint_least32_t tail = atomic_load_explicit(&ctx->updates.tail, memory_order_relaxed);
+    claimed = tail == *pos;
+    if (claimed)
+        atomic_store_explicit(&ctx->updates.tail, tail + 1, memory_order_relaxed);
+    HT1620_CRITICAL_EXIT();
+
+    *pos = tail;
+    return claimed;
+#else
+    return atomic_compare_exchange_weak_explicit(&ctx->updates.tail, pos, *pos + 1,
+                                                 memory_order_relaxed, memory_order_relaxed);
+#endif
 }
 
-void *reverseBytes(void *inp, size_t len)
+bool HT1620Post(HT1620_ctx *ctx, const HT1620_Update_st *update)
 {
-    unsigned int i;
-    unsigned char *in = (unsigned char *)inp, tmp;
+    uint_least32_t pos = atomic_load_explicit(&ctx->updates.tail, memory_order_relaxed);
+    HT1620_UpdateCell_st *cell;
 
-    for (i = 0; i < len / 2; i++)
+    // bounded MPMC ring of D. Vyukov, consumer side simplified to a single consumer
+    for (;;)
     {
-        tmp = *(in + i);
-        *(in + i) = *(in + len - i - 1);
-        *(in + len - i - 1) = tmp;
+        cell = &ctx->updates.cell[pos % HT1620_UPDATE_QUEUE_LEN];
+        // positions wrap, only the distance counts
+        int32_t diff = (int32_t)(uint32_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - pos);
+
+        if (diff == 0)
+        {
+            // cell is free: claim the position, another producer may win it first
+            if (updatesClaim(ctx, &pos))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return false; // consumer has not taken the cell of the previous round yet
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ctx->updates.tail, memory_order_relaxed);
+        }
     }
 
-    return inp;
+    cell->update = *update;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    return true;
 }
 
-void wrBytes(uint8_t *ptr, uint8_t size)
+uint16_t HT1620FlushUpdates(HT1620_ctx *ctx)
 {
-    // probably need to use microsecond delays in this method
-    // after every pin toggle function to give display
-    // driver time for data reading. But current solution works for me
+    HT1620_Update_st value = {0}, battery = {0}, signal = {0};
+    bool hasValue = false, hasBattery = false, hasSignal = false;
+    uint64_t on = 0, off = 0;
+    uint16_t taken = 0;
 
-    // TODO: check wrong size
-    // lcd driver expects data in reverse order
-    reverseBytes(ptr, size);
+    // one round at most, producers posting all the time can't keep the consumer here
+    while (taken < HT1620_UPDATE_QUEUE_LEN)
+    {
+        uint_least32_t pos = ctx->updates.head;
+        HT1620_UpdateCell_st *cell = &ctx->updates.cell[pos % HT1620_UPDATE_QUEUE_LEN];
 
+        // not published yet: a producer claimed it and is still writing, take it next time
+        if (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1)
+            break;
 
+        HT1620_Update_st update = cell->update;
+        atomic_store_explicit(&cell->seq, pos + HT1620_UPDATE_QUEUE_LEN, memory_order_release);
+        ctx->updates.head = pos + 1;
+        taken++;
 
-    if (HT1620_hal->PinSck && HT1620_hal->PinMosi)
-    {
-        if (HT1620_hal->PinCs)
+        switch (update.op)
         {
-            HT1620_hal->PinCs(LOW);
-        }
-        for (size_t k = 0; k < size; k++)
-        {
-            // send bits into display one by one
-            for (size_t i = 0; i < BITS_PER_BYTE; i++)
-            {
-                HT1620_hal->PinSck(LOW);
-                HT1620_hal->PinMosi((ptr[k] & (0x80 >> i)) ? HIGH : LOW);
-                volatile uint32_t wait_loop_index = ((1500 * (SystemCoreClock / (100000 * 2))) / 10);
-                while(wait_loop_index != 0)
-                {
-                    wait_loop_index--;
-                }
-                HT1620_hal->PinSck(HIGH);
-                wait_loop_index = ((1500 * (SystemCoreClock / (100000 * 2))) / 10);
-                while(wait_loop_index != 0)
-                {
-                    wait_loop_index--;
-                }
-            }
+        case HT1620_UPD_NUM:
+        case HT1620_UPD_FIXED:
+            value = update;
+            hasValue = true;
+            break;
+        case HT1620_UPD_BATTERY:
+            // the level is drawn before the symbols, earlier changes to its segments must not win
+            battery = update;
+            hasBattery = true;
+            on &= ~BATTERY_SYMBOLS;
+            off &= ~BATTERY_SYMBOLS;
+            break;
+        case HT1620_UPD_SIGNAL:
+            signal = update;
+            hasSignal = true;
+            on &= ~SIGNAL_SYMBOLS;
+            off &= ~SIGNAL_SYMBOLS;
+            break;
+        case HT1620_UPD_SYMBOLS:
+            // the same as applying them one by one
+            on = (on & ~update.off) | update.on;
+            off |= update.off;
+            break;
+        default:
+            break;
         }
     }
 
-    if (HT1620_hal->PinCs)
-        HT1620_hal->PinCs(HIGH);
+    if (!taken)
+        return 0;
+
+    HT1620BeginUpdate(ctx);
+    if (hasValue && value.op == HT1620_UPD_NUM)
+        HT1620printNum(ctx, value.value);
+    else if (hasValue)
+        HT1620printFixed(ctx, value.value, value.arg);
+    if (hasBattery)
+        HT1620batteryLevel(ctx, battery.value);
+    if (hasSignal)
+        HT1620SignalLevel(ctx, signal.value);
+    if (on || off)
+        HT1620SetSymbols(ctx, on, off);
+    HT1620Commit(ctx);
+
+    return taken;
 }
+#endif
 
-void wrBuffer()
+static void rdRun(HT1620_ctx *ctx, uint8_t start, uint8_t count, uint8_t *nibbles)
 {
-    buffer[0] = MODE_DATA | (0 << ADR0_SHIFT);
-    buffer[1] |= (0 << ADR1_SHIFT);
+    const HT1620_HAL_st *hal = ctx->hal;
+    uint16_t header = (MODE_READ << ADDR_BITS) | start;
+
+    busAcquire(ctx);
+    if (hal->PinCs)
+        hal->PinCs(LOW);
+    busDelay(ctx, HT1620_DELAY_CS_SETUP);
+
+    // ID and address are clocked in by WR like any other frame, most significant bit first
+    for (uint8_t n = DATA_OFFSET; n > 0; n--)
+    {
+        hal->PinSck(LOW);
+        hal->PinMosi((header >> (n - 1)) & 1);
+        busDelay(ctx, HT1620_DELAY_CLK_LOW);
+        hal->PinSck(HIGH);
+        busDelay(ctx, HT1620_DELAY_CLK_HIGH);
+    }
+    hal->PinDataDir(true); // the chip drives DATA from the first RD edge on
+
+    // D0..D3 of every address come out on RD falling edges, address increments by itself
+    for (uint8_t k = 0; k < count; k++)
+    {
+        nibbles[k] = 0;
+        for (uint8_t b = 0; b < NIBBLE_BITS; b++)
+        {
+            hal->PinRd(LOW);
+            busDelay(ctx, HT1620_DELAY_RD_LOW);
+            nibbles[k] |= hal->PinData() << b;
+            hal->PinRd(HIGH);
+            busDelay(ctx, HT1620_DELAY_RD_HIGH);
+        }
+    }
 
-    wrBytes(buffer, sizeof(buffer));
+    busDelay(ctx, HT1620_DELAY_CS_HOLD);
+    if (hal->PinCs)
+        hal->PinCs(HIGH);
+    hal->PinDataDir(false); // chip has released DATA with CS high
+    if (hal->Bus)
+        hal->Bus->owner = NULL;
+    busDelay(ctx, HT1620_DELAY_CS_HIGH);
+
+    STATS_ADD(frames, 1);
+    STATS_ADD(bits, DATA_OFFSET + count * NIBBLE_BITS);
+    STATS_ADD(addrScrubbed, count);
+    ENERGY_ADD(busPc, 2 + (DATA_OFFSET + count * NIBBLE_BITS) * 2, EdgePc);
 }
 
-void wrCmd(uint8_t cmd)
+uint8_t HT1620Scrub(HT1620_ctx *ctx, uint8_t count)
 {
-    union
+    const HT1620_HAL_st *hal = ctx->hal;
+    uint8_t nibbles[RAM_SIZE];
+    uint32_t corrupted = 0;
+    uint8_t found = 0;
+    uint8_t start = ctx->scrubAddr;
+
+    if (!hal->PinRd || !hal->PinData || !hal->PinDataDir || !hal->PinSck || !hal->PinMosi || !count)
+        return 0;
+    count = MIN(count, RAM_SIZE);
+
+    // once the queue is sent the driver RAM must hold the shadow
+    txDrain(ctx);
+    rdRun(ctx, start, count, nibbles);
+    ctx->scrubAddr = (start + count) % RAM_SIZE;
+
+    for (uint8_t k = 0; k < count; k++)
     {
-        struct __attribute__((packed))
+        uint8_t addr = (start + k) % RAM_SIZE;
+        if (nibbles[k] != frameNibble(ctx->shadow, addr))
         {
-#if defined LITTLE_ENDIAN
-            uint16_t padding : 4;
-            uint16_t data : 8;
-            uint16_t type : 4;
-#elif defined BIG_ENDIAN
-            uint16_t type : 4;
-            uint16_t data : 8;
-            uint16_t padding : 4;
-#endif
-        };
-        uint8_t arr[2];
-    } CommandSeq;
-    CommandSeq.type = MODE_CMD;
-    CommandSeq.data = cmd;
+            corrupted |= 1UL << addr;
+            found++;
+        }
+    }
+
+    if (found)
+    {
+        // the usual flush sends them, merged with pending changes if there are any
+        STATS_ADD(addrRepaired, found);
+        ctx->ramDirty |= corrupted;
+        wrBuffer(ctx);
+    }
+
+    return found;
+}
 
-    wrBytes(CommandSeq.arr, sizeof(CommandSeq));
+void HT1620WriteCmds(HT1620_ctx *ctx, const uint8_t *cmds, uint8_t count)
+{
+    while (count)
+    {
+        // command ID 100 once, then command bits C8..C0 of every command. The 8 bit HT1620_CMD_*
+        // codes hold C7..C0, so C8 is sent as 0; C0 is don't care and kept 0 by the codes
+        uint8_t chunk = MIN(count, CMDS_PER_FRAME);
+        uint8_t *frame = txAlloc(ctx)->data;
+        STATS_ADD(commands, chunk);
+        ENERGY_ADD(commandPc, chunk, CommandPc);
+        uint16_t n = 0;
+
+        memset(frame, 0, (ID_BITS + chunk * CMD_BITS + BITS_PER_BYTE - 1) / BITS_PER_BYTE);
+
+        n = frameBitsPut(frame, n, MODE_CMD, ID_BITS);
+        for (uint8_t i = 0; i < chunk; i++)
+            n = frameBitsPut(frame, n, cmds[i], CMD_BITS);
+
+        txPush(ctx, n);
+        cmds += chunk;
+        count -= chunk;
+    }
 }
 
-void HT1620batteryLevel(uint8_t percents)
+void HT1620batteryLevel(HT1620_ctx *ctx, uint8_t percents)
 {
-    batteryBufferClear();
-    SET_BIT(buffer[BAT14_POS], BAT4_SEG);
+    batteryBufferClear(ctx);
+    SET_BIT(ctx->buffer[BAT14_POS], BAT4_SEG);
     if (percents > 75)
     {
-        SET_BIT(buffer[BAT14_POS], BAT1_SEG);
+        SET_BIT(ctx->buffer[BAT14_POS], BAT1_SEG);
     }
     if (percents > 50)
     {
-        SET_BIT(buffer[BAT23_POS], BAT2_SEG);
+        SET_BIT(ctx->buffer[BAT23_POS], BAT2_SEG);
     }
     if (percents > 25)
     {
-        SET_BIT(buffer[BAT23_POS], BAT3_SEG);
+        SET_BIT(ctx->buffer[BAT23_POS], BAT3_SEG);
     }
-    wrBuffer();
+    wrBuffer(ctx);
 }
 
-void batteryBufferClear()
+void batteryBufferClear(HT1620_ctx *ctx)
 {
-    CLEAR_BIT(buffer[BAT14_POS], BAT1_SEG | BAT4_SEG);
-    CLEAR_BIT(buffer[BAT23_POS], BAT2_SEG | BAT3_SEG);
+    CLEAR_BIT(ctx->buffer[BAT14_POS], BAT1_SEG | BAT4_SEG);
+    CLEAR_BIT(ctx->buffer[BAT23_POS], BAT2_SEG | BAT3_SEG);
 }
 
-void dotsBufferClear()
+void dotsBufferClear(HT1620_ctx *ctx)
 {
     for (size_t i = 0; i < PRECISION_MAX_POSITIVE; i++)
     {
-        CLEAR_BIT(buffer[P1_POS + i], P1_SEG);
+        CLEAR_BIT(ctx->buffer[P1_POS + i], P1_SEG);
     }
 }
 
-void lettersBufferClear()
+void lettersBufferClear(HT1620_ctx *ctx)
 {
     for (size_t i = 0; i < DISPLAY_SIZE; i++)
     {
-        CLEAR_BIT(buffer[NUM1FGE_POS + i], NUM1FGE_SEG);
-        CLEAR_BIT(buffer[NUM1ABCD_POS + i], NUM1ABC_SEG);
-        CLEAR_BIT(buffer[NUM1ABCD_POS + i], NUM1D_SEG);
+        CLEAR_BIT(ctx->buffer[NUM1FGE_POS + i], NUM1FGE_SEG);
+        CLEAR_BIT(ctx->buffer[NUM1ABCD_POS + i], NUM1ABC_SEG);
+        CLEAR_BIT(ctx->buffer[NUM1ABCD_POS + i], NUM1D_SEG);
     }
 }
 
-void AllClear()
+void AllClear(HT1620_ctx *ctx)
 {
-    CLEAR_BIT(buffer[ALL_CLEAR_POS], ALL_CLEAR_SEG);
+    CLEAR_BIT(ctx->buffer[ALL_CLEAR_POS], ALL_CLEAR_SEG);
     for (size_t i = 0; i < DATA_SIZE; i++)
     {
-        buffer[i + SYS_SIZE] = 0;
+        ctx->buffer[i + SYS_SIZE] = 0;
     }
 }
-void clear()
+void HT1620clear(HT1620_ctx *ctx)
 {
-    AllClear();
+    HT1620ScrollStop(ctx);
+    AllClear(ctx);
 
-    wrBuffer();
+    wrBuffer(ctx);
 }
 
 void bufferToAscii(const char *in, uint8_t *out)
 {
-    for (size_t i = 0; i < MIN(DISPLAY_SIZE, strlen(in)); i++)
+    for (uint8_t i = 0; i < DISPLAY_SIZE && in[i]; i++)
+        glyphPut(out, i, glyphOf(in[i]));
+}
+
+static const glyph_st *glyphOf(char c)
+{
+    if (c >= 'a' && c <= 'z')
+        c -= 'a' - 'A';
+    if (c < ' ' || c >= (int)(' ' + GLYPHS_COUNT))
+        c = ' ';
+
+    return &glyphs[c - ' '];
+}
+
+static void glyphPut(uint8_t *out, uint8_t pos, const glyph_st *glyph)
+{
+    SET_BIT(out[NUM1FGE_POS + pos], glyph->fge);
+    SET_BIT(out[NUM1ABCD_POS + pos], glyph->abcd);
+}
+
+void numToSegments(int32_t num, uint8_t *out)
+{
+    uint8_t digits[10]; // least significant first
+    uint8_t count = 0;
+    uint32_t value = (num < 0) ? 0 - (uint32_t)num : (uint32_t)num;
+
+    // two digits per step, no division and no string in between
+    do
     {
-        char c = in[i];
-        // Handle situation when char is out of displayable ascii table part.
-        // Show space instead
-        if ((c < ' ') || (c - ' ' > (int)sizeof(ascii)))
-        {
-            CLEAR_BIT(out[NUM1FGE_POS + i], NUM1FGE_SEG);
-            CLEAR_BIT(out[NUM1ABCD_POS + i], NUM1ABC_SEG);
-            CLEAR_BIT(out[NUM1ABCD_POS + i], NUM1D_SEG);
-        }
-        else
-        {
-            //02345678 conversion to 67805234
-            SET_BIT(out[NUM1FGE_POS + i], NUM1FGE_SEG & (ascii[c - ' ']) << 5);  // shift 5 for changing data format from library to our display
-            SET_BIT(out[NUM1ABCD_POS + i], NUM1ABC_SEG & (ascii[c - ' ']) >> 4); // shift 3 for changing data format from library to our display
-            SET_BIT(out[NUM1ABCD_POS + i], NUM1D_SEG & (ascii[c - ' ']));        // 4 bit not shifted in our display
-        }
+        uint32_t rest = DIV100(value);
+        uint8_t pair = digitPairs[value - rest * 100];
+
+        digits[count++] = pair & 0x0F;
+        digits[count++] = pair >> 4;
+        value = rest;
+    } while (value);
+
+    if (digits[count - 1] == 0 && count > 1)
+        count--;
+
+    uint8_t width = MAX(PRINT_NUM_WIDTH, count + (num < 0));
+    for (uint8_t pos = 0; pos < MIN(width, DISPLAY_SIZE); pos++)
+    {
+        uint8_t i = width - 1 - pos; // digit number from the right
+
+        if (i < count)
+            glyphPut(out, pos, &glyphs['0' - ' ' + digits[i]]);
+        else if (i == count && num < 0)
+            glyphPut(out, pos, &glyphs['-' - ' ']);
+    }
+}
+
+void HT1620printStr(HT1620_ctx *ctx, const char *str)
+{
+    HT1620ScrollStop(ctx);
+    dotsBufferClear(ctx);
+    lettersBufferClear(ctx);
+    bufferToAscii(str, ctx->buffer);
+    wrBuffer(ctx);
+}
+
+void HT1620Scroll(HT1620_ctx *ctx, const char *text, uint16_t period)
+{
+    size_t len = strlen(text);
+
+    if (len <= DISPLAY_SIZE)
+    {
+        HT1620printStr(ctx, text);
+        return;
+    }
+
+    ctx->scroll.text = text;
+    ctx->scroll.len = MIN(len, UINT16_MAX - DISPLAY_SIZE);
+    ctx->scroll.pos = DISPLAY_SIZE;
+    ctx->scroll.period = period ? period : 1;
+    ctx->scroll.ticks = 0;
+
+    dotsBufferClear(ctx);
+    scrollDraw(ctx);
+}
+
+bool HT1620ScrollTick(HT1620_ctx *ctx)
+{
+    if (!ctx->scroll.text)
+        return false;
+
+    if (++ctx->scroll.ticks < ctx->scroll.period)
+        return true;
+    ctx->scroll.ticks = 0;
+
+    // a full turn is the text plus a blank glass
+    if (++ctx->scroll.pos == ctx->scroll.len + DISPLAY_SIZE)
+        ctx->scroll.pos = 0;
+    scrollDraw(ctx);
+
+    return true;
+}
+
+void HT1620ScrollStop(HT1620_ctx *ctx)
+{
+    ctx->scroll.text = 0;
+}
+
+static void scrollDraw(HT1620_ctx *ctx)
+{
+    lettersBufferClear(ctx);
+    for (uint8_t i = 0; i < DISPLAY_SIZE; i++)
+    {
+        uint16_t n = ctx->scroll.pos + i; // index in the text preceded by DISPLAY_SIZE blanks
+
+        if (n >= DISPLAY_SIZE && n < ctx->scroll.len + DISPLAY_SIZE)
+            glyphPut(ctx->buffer, i, glyphOf(ctx->scroll.text[n - DISPLAY_SIZE]));
     }
+
+    // only digit segments have changed, so the flush sends only their addresses
+    wrBuffer(ctx);
+}
+
+void HT1620Carousel(HT1620_ctx *ctx, const HT1620_Page_st *pages, uint8_t count)
+{
+    if (!count)
+        return;
+
+    ctx->carousel.pages = pages;
+    ctx->carousel.count = count;
+    ctx->carousel.current = 0;
+    ctx->carousel.ticks = 0;
+    pageShow(ctx);
+}
+
+bool HT1620CarouselTick(HT1620_ctx *ctx)
+{
+    if (!ctx->carousel.pages)
+        return false;
+
+    if (++ctx->carousel.ticks < MAX(ctx->carousel.pages[ctx->carousel.current].dwell, 1))
+        return true;
+    ctx->carousel.ticks = 0;
+
+    ctx->carousel.current = (ctx->carousel.current + 1) % ctx->carousel.count;
+    pageShow(ctx);
+
+    return true;
+}
+
+void HT1620CarouselStop(HT1620_ctx *ctx)
+{
+    ctx->carousel.pages = 0;
 }
 
-void HT1620printStr(const char *str)
+static void pageShow(HT1620_ctx *ctx)
 {
-    dotsBufferClear();
-    lettersBufferClear();
-    bufferToAscii(str, buffer);
-    wrBuffer();
+    const HT1620_Page_st *page = &ctx->carousel.pages[ctx->carousel.current];
+
+    // previous page may have left scrolling on
+    HT1620ScrollStop(ctx);
+
+    HT1620BeginUpdate(ctx);
+    if (page->render)
+    {
+        AllClear(ctx);
+        page->render(ctx, page->arg);
+    }
+    else
+    {
+        memcpy(ctx->buffer, page->frame, sizeof(ctx->buffer));
+    }
+
+    // one flush of what differs from the previous page
+    HT1620Commit(ctx);
 }
 
-void HT1620printNum(int32_t num)
+void HT1620printNum(HT1620_ctx *ctx, int32_t num)
 {
     if (num > MAX_NUM)
         num = MAX_NUM;
     if (num < MIN_NUM)
         num = MIN_NUM;
 
-    dotsBufferClear();
-    lettersBufferClear();
+    HT1620ScrollStop(ctx);
+    dotsBufferClear(ctx);
+    lettersBufferClear(ctx);
+    numToSegments(num, ctx->buffer);
 
-    char str[DISPLAY_SIZE + 1] = {0};
-#if __STDC_WANT_LIB_EXT1__ == 1
-        snprintf_s(str, sizeof(str), "%6li", num);
-#else
-        snprintf(str, sizeof(str), "%6li", num);
-#endif
+    wrBuffer(ctx);
+}
+
+uint32_t floatScale(uint32_t bits, uint8_t precision)
+{
+    int16_t exp = (bits >> FLOAT_MANT_BITS) & FLOAT_EXP_MASK;
+    uint64_t mant = bits & ((1UL << FLOAT_MANT_BITS) - 1);
+
+    if (exp == FLOAT_EXP_MASK) // inf or nan
+        return MAX_NUM;
+    if (exp)
+        mant |= 1UL << FLOAT_MANT_BITS;
+    else
+        exp = 1; // denormal
+
+    // value = mant * 2^shift, mant * 10^precision takes at most 41 bits
+    int16_t shift = exp - FLOAT_EXP_BIAS - FLOAT_MANT_BITS;
+    uint64_t scaled = mant * powersOf10[precision];
 
-    bufferToAscii(str, buffer);
+    if (shift >= 0)
+    {
+        // mant has its top bit set here, so 7 more bits are beyond MAX_NUM for sure
+        if (shift >= 7)
+            return MAX_NUM;
+        scaled <<= shift;
+    }
+    else
+    {
+        if (-shift > 42)
+            return 0;
+        scaled = (scaled + (1ULL << (-shift - 1))) >> -shift;
+    }
 
-    wrBuffer();
+    return MIN(scaled, MAX_NUM);
 }
 
-void HT1620printFloat(float num, uint8_t precision)
+void HT1620printFloat(HT1620_ctx *ctx, float num, uint8_t precision)
 {
-    if (num >= 0 && precision > PRECISION_MAX_POSITIVE)
+    uint32_t bits;
+    memcpy(&bits, &num, sizeof(bits));
+
+    bool negative = bits & FLOAT_SIGN;
+    bits &= ~FLOAT_SIGN;
+
+    if (!negative && precision > PRECISION_MAX_POSITIVE)
         precision = PRECISION_MAX_POSITIVE;
-    else if (num < 0 && precision > PRECISION_MAX_NEGATIVE)
+    else if (negative && precision > PRECISION_MAX_NEGATIVE)
         precision = PRECISION_MAX_NEGATIVE;
 
-    if (num < (float)MIN_NUM / 10)
+    // positive floats compare the same way as their bits do
+    if (negative && bits > FLOAT_BITS_1E8)
     {
-        num = num * (-1);
-        SET_BIT(buffer[MINUS_POS], MINUS_SEG);
+        negative = false;
+        SET_BIT(ctx->buffer[MINUS_POS], MINUS_SEG);
     }
     else
     {
-        CLEAR_BIT(buffer[MINUS_POS], MINUS_SEG);
+        CLEAR_BIT(ctx->buffer[MINUS_POS], MINUS_SEG);
     }
 
-    int32_t integerated = (int32_t)(num * pow(10, precision));
+    HT1620BeginUpdate(ctx);
 
-    if (integerated > MAX_NUM)
-        integerated = MAX_NUM;
-    if (integerated < MIN_NUM)
-        integerated = MIN_NUM;
+    int32_t integerated = floatScale(bits, precision);
 
-    HT1620printNum(integerated);
-    decimalSeparator(precision);
+    HT1620printNum(ctx, negative ? -integerated : integerated);
+    decimalSeparator(ctx, precision);
 
-    wrBuffer();
+    HT1620Commit(ctx);
 }
 
 // TODO: make multiplier more strict.
-void HT1620printFixed(int32_t multiplied_float, uint32_t multiplier)
+void HT1620printFixed(HT1620_ctx *ctx, int32_t multiplied_float, uint32_t multiplier)
 {
     uint8_t precision = 0;
 
@@ -706,312 +1580,309 @@ void HT1620printFixed(int32_t multiplied_float, uint32_t multiplier)
     if (multiplied_float < MIN_NUM)
         multiplied_float = MIN_NUM;
 
-    HT1620printNum((int32_t)multiplied_float);
-    decimalSeparator(precision);
+    HT1620BeginUpdate(ctx);
+    HT1620printNum(ctx, (int32_t)multiplied_float);
+    decimalSeparator(ctx, precision);
 
-    wrBuffer();
+    HT1620Commit(ctx);
 }
 
-void decimalSeparator(uint8_t dpPosition)
+void decimalSeparator(HT1620_ctx *ctx, uint8_t dpPosition)
 {
-    dotsBufferClear();
-
+    // dots share their bits with the A segments of digits 4 to 8, callers clear the dots
+    // before the digits are drawn, clearing them here would cut the top off those digits
     if (dpPosition < PRECISION_MIN || dpPosition > PRECISION_MAX_POSITIVE)
         // selected dot position not supported by display hardware
         return;
 
-    SET_BIT(buffer[P5_POS - dpPosition + 1], P1_SEG);
+    SET_BIT(ctx->buffer[P5_POS - dpPosition + 1], P1_SEG);
 }
 
-void HT1620DispMinMax(bool enable, bool mode, bool min)
+void HT1620SetSymbols(HT1620_ctx *ctx, uint64_t on, uint64_t off)
 {
-    if (enable)
-    {
-        if (mode)
-        {
-            LCD_TOGGLE(min, MIN_RU_POS, MIN_RU_SEG, MAX_RU_POS, MAX_RU_SEG);
-        }
-        else
-        {
-            LCD_TOGGLE(min, MIN_EN_POS, MIN_EN_SEG, MAX_EN_POS, MAX_EN_SEG);
-        }
-    }
-    else
-    {
-        CLEAR_BIT(buffer[MIN_RU_POS], MIN_RU_SEG);
-        CLEAR_BIT(buffer[MAX_RU_POS], MAX_RU_SEG);
-        CLEAR_BIT(buffer[MIN_EN_POS], MIN_EN_SEG);
-        CLEAR_BIT(buffer[MAX_EN_POS], MAX_EN_SEG);
-    }
+    symbolsApply(ctx->buffer, on, off);
 }
 
-void HT1620DispBurst(bool enable, bool mode)
+static void symbolsApply(uint8_t *frame, uint64_t on, uint64_t off)
 {
-    if (enable)
+    uint8_t set[DISPLAY_BUFFER_SIZE] = {0};
+    uint8_t keep[DISPLAY_BUFFER_SIZE];
+
+    // mask bits past the last icon have no table entry
+    on &= HT1620_SYM(HT1620_SYM_COUNT) - 1;
+    off &= HT1620_SYM(HT1620_SYM_COUNT) - 1;
+
+    memset(keep, 0xFF, sizeof(keep));
+    for (uint8_t sym = 0; off; sym++, off >>= 1)
     {
-        LCD_SWITCH(mode, BURST_RU_POS, BURST_RU_SEG);
+        if (off & 1)
+            CLEAR_BIT(keep[symbols[sym].pos], symbols[sym].seg);
     }
-    else
+    for (uint8_t sym = 0; on; sym++, on >>= 1)
     {
-        CLEAR_BIT(buffer[BURST_RU_POS], BURST_RU_SEG);
-        CLEAR_BIT(buffer[BURST_EN_POS], BURST_EN_SEG);
+        if (on & 1)
+            SET_BIT(set[symbols[sym].pos], symbols[sym].seg);
     }
+
+    // one pass over the frame, whatever number of icons has changed
+    for (uint8_t i = 0; i < DISPLAY_BUFFER_SIZE; i++)
+        frame[i] = (frame[i] & keep[i]) | set[i];
 }
 
-void HT1620DispLeak(bool enable, bool mode)
+void HT1620BlinkSymbols(HT1620_ctx *ctx, uint64_t on, uint64_t off)
 {
-    if (enable)
-    {
-        LCD_SWITCH(mode, LEAK_RU_POS, LEAK_RU_SEG);
-    }
-    else
-    {
-        CLEAR_BIT(buffer[LEAK_RU_POS], LEAK_RU_SEG);
-        CLEAR_BIT(buffer[LEAK_EN_POS], LEAK_EN_SEG);
-    }
+    symbolsApply(ctx->blink.mask, on, off);
 }
 
-void HT1620DispRev(bool enable, bool mode)
+void HT1620BlinkDigits(HT1620_ctx *ctx, uint16_t digits)
 {
-    if (enable)
+    for (uint8_t i = 0; i < DISPLAY_SIZE; i++)
     {
-        LCD_SWITCH(mode, REV_RU_POS, REV_RU_SEG);
+        CLEAR_BIT(ctx->blink.mask[NUM1FGE_POS + i], NUM1FGE_SEG);
+        CLEAR_BIT(ctx->blink.mask[NUM1ABCD_POS + i], NUM1ABC_SEG | NUM1D_SEG);
+        if ((digits >> i) & 1)
+        {
+            SET_BIT(ctx->blink.mask[NUM1FGE_POS + i], NUM1FGE_SEG);
+            SET_BIT(ctx->blink.mask[NUM1ABCD_POS + i], NUM1ABC_SEG | NUM1D_SEG);
+        }
     }
-    else
+}
+
+void HT1620SetBlinkPeriod(HT1620_ctx *ctx, uint16_t period)
+{
+    ctx->blink.period = period;
+}
+
+bool HT1620BlinkTick(HT1620_ctx *ctx)
+{
+    if (!blinkAny(ctx))
     {
-        CLEAR_BIT(buffer[REV_RU_POS], REV_RU_SEG);
-        CLEAR_BIT(buffer[REV_EN_POS], REV_EN_SEG);
+        // blinking stopped in the off phase: show the segments again
+        if (ctx->blink.off)
+        {
+            ctx->blink.off = false;
+            wrBuffer(ctx);
+        }
+        return false;
     }
+
+    if (++ctx->blink.ticks < MAX(ctx->blink.period, 1))
+        return true;
+    ctx->blink.ticks = 0;
+
+    // only addresses holding shown blinking segments differ from the last flush
+    ctx->blink.off = !ctx->blink.off;
+    wrBuffer(ctx);
+
+    return true;
 }
 
-void HT1620DispFrost(bool enable)
+static bool blinkAny(HT1620_ctx *ctx)
 {
-    LCD_SWITCH(enable, FROST_POS, FROST_SEG);
+    uint8_t any = 0;
+
+    for (uint8_t i = 0; i < DISPLAY_BUFFER_SIZE; i++)
+        any |= ctx->blink.mask[i];
+
+    return any;
 }
 
-void HT1620DispQ(bool enable)
+// icon with russian and english variants: one of them or none
+static void symbolLang(HT1620_ctx *ctx, bool enable, bool mode, uint8_t ru, uint8_t en)
 {
-    LCD_SWITCH(enable, Q_POS, Q_SEG);
+    uint64_t both = HT1620_SYM(ru) | HT1620_SYM(en);
+
+    HT1620SetSymbols(ctx, enable ? HT1620_SYM(mode ? ru : en) : 0, both);
 }
 
-void HT1620DispVer(bool enable, bool mode)
+static void symbolSwitch(HT1620_ctx *ctx, bool enable, uint8_t sym)
 {
-    if (enable)
-    {
-        LCD_SWITCH(mode, VER_RU_POS, VER_RU_SEG);
-    }
-    else
-    {
-        CLEAR_BIT(buffer[VER_RU_POS], VER_RU_SEG);
-        CLEAR_BIT(buffer[VER_EN_POS], VER_EN_SEG);
-    }
+    HT1620SetSymbols(ctx, enable ? HT1620_SYM(sym) : 0, HT1620_SYM(sym));
 }
 
-void HT1620DispSN(bool enable, bool mode)
+void HT1620DispMinMax(HT1620_ctx *ctx, bool enable, bool mode, bool min)
 {
     if (enable)
     {
-        LCD_SWITCH(mode, SN_RU_POS, SN_RU_SEG);
+        // only the pair of the selected language is switched
+        if (mode)
+            symbolLang(ctx, true, min, HT1620_SYM_MIN_RU, HT1620_SYM_MAX_RU);
+        else
+            symbolLang(ctx, true, min, HT1620_SYM_MIN_EN, HT1620_SYM_MAX_EN);
     }
     else
     {
-        CLEAR_BIT(buffer[SN_RU_POS], SN_RU_SEG);
-        CLEAR_BIT(buffer[SN_EN_POS], SN_EN_SEG);
+        HT1620SetSymbols(ctx, 0, SYM(MIN_RU) | SYM(MAX_RU) | SYM(MIN_EN) | SYM(MAX_EN));
     }
 }
 
-void HT1620DispWarn(bool enable)
+void HT1620DispBurst(HT1620_ctx *ctx, bool enable, bool mode)
+{
+    symbolLang(ctx, enable, mode, HT1620_SYM_BURST_RU, HT1620_SYM_BURST_EN);
+}
+
+void HT1620DispLeak(HT1620_ctx *ctx, bool enable, bool mode)
+{
+    symbolLang(ctx, enable, mode, HT1620_SYM_LEAK_RU, HT1620_SYM_LEAK_EN);
+}
+
+void HT1620DispRev(HT1620_ctx *ctx, bool enable, bool mode)
+{
+    symbolLang(ctx, enable, mode, HT1620_SYM_REV_RU, HT1620_SYM_REV_EN);
+}
+
+void HT1620DispFrost(HT1620_ctx *ctx, bool enable)
+{
+    symbolSwitch(ctx, enable, HT1620_SYM_FROST);
+}
+
+void HT1620DispQ(HT1620_ctx *ctx, bool enable)
+{
+    symbolSwitch(ctx, enable, HT1620_SYM_Q);
+}
+
+void HT1620DispVer(HT1620_ctx *ctx, bool enable, bool mode)
+{
+    symbolLang(ctx, enable, mode, HT1620_SYM_VER_RU, HT1620_SYM_VER_EN);
+}
+
+void HT1620DispSN(HT1620_ctx *ctx, bool enable, bool mode)
+{
+    symbolLang(ctx, enable, mode, HT1620_SYM_SN_RU, HT1620_SYM_SN_EN);
+}
+
+void HT1620DispWarn(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, WARN_POS, WARN_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_WARN);
 }
 
-void HT1620DispMagn(bool enable)
+void HT1620DispMagn(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, MAGNET_POS, MAGNET_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_MAGNET);
 }
 
-void HT1620DispLeft(bool enable)
+void HT1620DispLeft(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, LEFT_POS, LEFT_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_LEFT);
 }
 
-void HT1620DispRight(bool enable)
+void HT1620DispRight(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, RIGHT_POS, RIGHT_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_RIGHT);
 }
 
-void HT1620DispNoWater(bool enable)
+void HT1620DispNoWater(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, NOWATER_POS, NOWATER_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_NOWATER);
 }
 
-void HT1620DispCRC(bool enable)
+void HT1620DispCRC(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, CRC_POS, CRC_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_CRC);
 }
 
-void HT1620DispDelta(bool enable)
+void HT1620DispDelta(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, DELTA_POS, DELTA_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_DELTA);
 }
 
-void HT1620DispT(bool enable)
+void HT1620DispT(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, T_POS, T_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_T);
 }
 
-void HT1620Disp1(bool enable)
+void HT1620Disp1(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, T1_POS, T1_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_T1);
 }
 
-void HT1620DispT2(bool enable)
+void HT1620DispT2(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, T2_POS, T2_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_T2);
 }
 
-void HT1620DispNBFi(bool enable)
+void HT1620DispNBFi(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, NBFI_POS, NBFI_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_NBFI);
 }
 
-void HT1620DispNBIoT(bool enable)
+void HT1620DispNBIoT(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, NBIOT_POS, NBIOT_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_NBIOT);
 }
 
-void HT1620SignalLevel(uint8_t percents)
+void HT1620SignalLevel(HT1620_ctx *ctx, uint8_t percents)
 {
-    CLEAR_BIT(buffer[SIG1_POS], SIG1_SEG);
-    CLEAR_BIT(buffer[SIG2_POS], SIG2_SEG);
-    CLEAR_BIT(buffer[SIG3_POS], SIG3_SEG);
+    CLEAR_BIT(ctx->buffer[SIG1_POS], SIG1_SEG);
+    CLEAR_BIT(ctx->buffer[SIG2_POS], SIG2_SEG);
+    CLEAR_BIT(ctx->buffer[SIG3_POS], SIG3_SEG);
     if (percents > 60)
     {
-        SET_BIT(buffer[SIG3_POS], SIG3_SEG);
+        SET_BIT(ctx->buffer[SIG3_POS], SIG3_SEG);
     }
     if (percents > 30)
     {
-        SET_BIT(buffer[SIG2_POS], SIG2_SEG);
+        SET_BIT(ctx->buffer[SIG2_POS], SIG2_SEG);
     }
     if (percents > 0)
     {
-        SET_BIT(buffer[SIG1_POS], SIG1_SEG);
+        SET_BIT(ctx->buffer[SIG1_POS], SIG1_SEG);
     }
 }
 
-void HT1620DispDegreePoint(bool enable)
+void HT1620DispDegreePoint(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, DEGREE_POS, DEGREE_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_DEGREE);
 }
 
-void HT1620DispEnergyJ(bool enable, bool mode, bool perH)
+void HT1620DispEnergyJ(HT1620_ctx *ctx, bool enable, bool mode, bool perH)
 {
     if (enable)
     {
         if (mode)
-        {
-            SET_BIT(buffer[GCAL_POS], GCAL_SEG);
-            LCD_SWITCH(perH, GCAL_H_POS, GCAL_H_SEG);
-        }
+            HT1620SetSymbols(ctx, SYM(GCAL) | (perH ? SYM(GCAL_H) : 0), SYM(GCAL_H));
         else
-        {
-            SET_BIT(buffer[GJ_POS], GJ_SEG);
-            LCD_SWITCH(perH, GJ_H_POS, GJ_H_SEG);
-        }
+            HT1620SetSymbols(ctx, SYM(GJ) | (perH ? SYM(GJ_H) : 0), SYM(GJ_H));
     }
     else
     {
-        CLEAR_BIT(buffer[GJ_POS], GJ_SEG);
-        CLEAR_BIT(buffer[GJ_H_POS], GJ_H_SEG);
-        CLEAR_BIT(buffer[GCAL_POS], GCAL_SEG);
-        CLEAR_BIT(buffer[GCAL_H_POS], GCAL_H_SEG);
+        HT1620SetSymbols(ctx, 0, SYM(GJ) | SYM(GJ_H) | SYM(GCAL) | SYM(GCAL_H));
     }
 }
 
-void HT1620DispEnergyW(bool enable, bool M, bool perH)
+void HT1620DispEnergyW(HT1620_ctx *ctx, bool enable, bool M, bool perH)
 {
+    uint64_t all = SYM(W) | SYM(KW) | SYM(MW) | SYM(WH);
+
     if (enable)
-    {
-        SET_BIT(buffer[W_POS], W_SEG);
-        LCD_TOGGLE(M, MW_POS, MW_SEG, KW_POS, KW_SEG);
-        LCD_SWITCH(perH, WH_POS, WH_SEG);
-    }
+        HT1620SetSymbols(ctx, SYM(W) | (M ? SYM(MW) : SYM(KW)) | (perH ? SYM(WH) : 0), all);
     else
-    {
-        CLEAR_BIT(buffer[W_POS], W_SEG);
-        CLEAR_BIT(buffer[KW_POS], KW_SEG);
-        CLEAR_BIT(buffer[MW_POS], MW_SEG);
-        CLEAR_BIT(buffer[WH_POS], WH_SEG);
-    }
+        HT1620SetSymbols(ctx, 0, all);
 }
 
-void HT1620DispFlowM3(bool enable, bool mode, bool perH)
+void HT1620DispFlowM3(HT1620_ctx *ctx, bool enable, bool mode, bool perH)
 {
-    if (enable)
-    {
-        SET_BIT(buffer[M3_POS], M3_SEG);
-        if (perH)
-        {
-            SET_BIT(buffer[M3_H_POS], M3_H_SEG);
-            LCD_SWITCH(perH, M3_H_EN_POS, M3_H_EN_SEG);
-        }
-        else
-        {
-            CLEAR_BIT(buffer[M3_H_POS], M3_H_SEG);
-            CLEAR_BIT(buffer[M3_H_EN_POS], M3_H_EN_SEG);
-        }
-    }
-    else
-    {
-        CLEAR_BIT(buffer[M3_POS], M3_SEG);
-        CLEAR_BIT(buffer[M3_H_POS], M3_H_SEG);
-        CLEAR_BIT(buffer[M3_H_EN_POS], M3_H_EN_SEG);
-    }
+    uint64_t per = mode ? SYM(M3_H) : SYM(M3_H_EN);
+
+    HT1620SetSymbols(ctx, enable ? SYM(M3) | (perH ? per : 0) : 0, SYM(M3) | SYM(M3_H) | SYM(M3_H_EN));
 }
 
-void HT1620DispFlowGAL(bool enable, bool perH)
+void HT1620DispFlowGAL(HT1620_ctx *ctx, bool enable, bool perH)
 {
-    if (enable)
-    {
-        SET_BIT(buffer[GAL_POS], GAL_SEG);
-        LCD_SWITCH(perH, GAL_PM_POS, GAL_PM_SEG);
-    }
-    else
-    {
-        CLEAR_BIT(buffer[GAL_POS], GAL_SEG);
-        CLEAR_BIT(buffer[GAL_PM_POS], GAL_PM_SEG);
-    }
+    HT1620SetSymbols(ctx, enable ? SYM(GAL) | (perH ? SYM(GAL_PM) : 0) : 0, SYM(GAL) | SYM(GAL_PM));
 }
 
-void HT1620DispFlowFT(bool enable, bool perH)
+void HT1620DispFlowFT(HT1620_ctx *ctx, bool enable, bool perH)
 {
-    if (enable)
-    {
-        SET_BIT(buffer[FT3_POS], FT3_SEG);
-        LCD_SWITCH(perH, FT3_PM_POS, FT3_PM_SEG);
-    }
-    else
-    {
-        CLEAR_BIT(buffer[FT3_POS], FT3_SEG);
-        CLEAR_BIT(buffer[FT3_PM_POS], FT3_PM_SEG);
-    }
+    HT1620SetSymbols(ctx, enable ? SYM(FT3) | (perH ? SYM(FT3_PM) : 0) : 0, SYM(FT3) | SYM(FT3_PM));
 }
 
-void HT1620DispMMBTU(bool enable)
+void HT1620DispMMBTU(HT1620_ctx *ctx, bool enable)
 {
-    LCD_SWITCH(enable, MMBTU_POS, MMBTU_SEG);
+    symbolSwitch(ctx, enable, HT1620_SYM_MMBTU);
 }
 
-void HT1620DispGal(bool enable, bool mode)
+void HT1620DispGal(HT1620_ctx *ctx, bool enable, bool mode)
 {
-    if (enable)
-    {
-        SET_BIT(buffer[GALLONS_POS], GALLONS_SEG);
-        LCD_SWITCH(mode, US_POS, US_SEG);
-    }
-    else
-    {
-        CLEAR_BIT(buffer[GALLONS_POS], GALLONS_SEG);
-        CLEAR_BIT(buffer[US_POS], US_SEG);
-    }
-}
\ No newline at end of file
+    HT1620SetSymbols(ctx, enable ? SYM(GALLONS) | (mode ? SYM(US) : 0) : 0, SYM(GALLONS) | SYM(US));
+}
@@ -35,75 +35,785 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stdint.h>
 #include <stdbool.h>
 
+#define DISPLAY_SIZE 9                             // 16 * 8  = 128 symbols on display plus 2 byte for address
+#define SYS_SIZE 2                                 // 2 byte for address and commands
+#define DATA_SIZE 16                               // 16 * 8  = 128 symbols on display
+#define DISPLAY_BUFFER_SIZE (DATA_SIZE + SYS_SIZE) //  plus 2 byte for address
+#define HT1620_RAM_SIZE 32                         // driver RAM addresses, 4 bits each
+
+#ifndef HT1620_TX_QUEUE_LEN
+#define HT1620_TX_QUEUE_LEN 4 // frames that may wait for the bus in asynchronous mode
+#endif
+
+// define HT1620_CPU_HZ to the core clock when the HAL has no DelayNs, the busy wait is sized for it (72 MHz by default)
+// define HT1620_STATS to count bus traffic of every display, see HT1620GetStats()
+// define HT1620_ENERGY to estimate charge drawn by every display, see HT1620GetCharge()
+// define HT1620_FRAME_CACHE_SIZE to keep that many encoded screens per display, see HT1620CacheShow()
+// define HT1620_UPDATE_QUEUE_LEN (power of 2, needs C11 atomics) for updates posted from ISRs, see HT1620Post()
+// define HT1620_NO_CAS with HT1620_CRITICAL_ENTER()/HT1620_CRITICAL_EXIT() on cores without compare-and-swap
+
+#ifdef HT1620_UPDATE_QUEUE_LEN
+#ifdef __cplusplus
+#error "HT1620_UPDATE_QUEUE_LEN needs C11 atomics, it is not available to C++ units"
+#endif
+#include <stdatomic.h>
+#if defined(HT1620_NO_CAS) && !(defined(HT1620_CRITICAL_ENTER) && defined(HT1620_CRITICAL_EXIT))
+#error "HT1620_NO_CAS needs HT1620_CRITICAL_ENTER() and HT1620_CRITICAL_EXIT() masking interrupts"
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifndef HT1620_STATS_BUCKETS
+#define HT1620_STATS_BUCKETS 16 // flush duration histogram size, bucket i holds durations below 2^i
+#endif
+
+/**
+ * @brief DRIVER COMMANDS. See HT1620WriteCmds()
+ */
+#define HT1620_CMD_BIAS 0x52    //0b1000 0101 0010  1/3duty 4com
+#define HT1620_CMD_SYSDIS 0x00  //0b1000 0000 0000  Turn off both system oscillator and LCD bias generator
+#define HT1620_CMD_SYSEN 0x02   //0b1000 0000 0010  Turn on system oscillator
+#define HT1620_CMD_LCDOFF 0x04  //0b1000 0000 0100  Turn off LCD bias generator
+#define HT1620_CMD_LCDON 0x06   //0b1000 0000 0110  Turn on LCD bias generator
+#define HT1620_CMD_XTAL 0x28    //0b1000 0010 1000  System clock source, crystal oscillator
+#define HT1620_CMD_RC256 0x30   //0b1000 0011 0000  System clock source, on-chip RC oscillator
+#define HT1620_CMD_TONEON 0x12  //0b1000 0001 0010  Turn on tone outputs
+#define HT1620_CMD_TONEOFF 0x10 //0b1000 0001 0000  Turn off tone outputs
+#define HT1620_CMD_WDTDIS1 0x0A //0b1000 0000 1010  Disable WDT time-out flag output
+#define HT1620_CMD_CLRTMR 0x1A  //0b1000 0001 1010  Clear the time base generator
+
 typedef struct
 {
     void (*PinCs)(bool);
     void (*PinSck)(bool);
     void (*PinMosi)(bool);
+    /**
+     * Optional block transport (hardware SPI, DMA). Used instead of PinSck/PinMosi when set.
+     * Bit n of the frame is bit (n % 8) of data[n / 8]: configure SPI as LSB first,
+     * data stable on the rising clock edge (CPOL=0, CPHA=0). bits is the frame length,
+     * the last byte is padded so that clocking all size bytes is harmless.
+     * Chip select is still driven through PinCs.
+     */
+    void (*Transmit)(const uint8_t *data, uint8_t size, uint16_t bits);
+    /**
+     * Optional busy wait for at least ns nanoseconds. Bus timing comes from the selected
+     * HT1620_Timing_st profile. Without it the driver counts down a loop sized for
+     * HT1620_CPU_HZ, which defaults to 72 MHz
+     */
+    void (*DelayNs)(uint32_t ns);
+    /**
+     * Optional, the same object for all displays sharing PinSck/PinMosi (with separate PinCs).
+     * Keeps frames of these displays from overlapping on the bus
+     */
+    struct HT1620_Bus_st *Bus;
+    /**
+     * Optional free running counter in any unit (us, timer ticks, CPU cycles).
+     * Used with HT1620_STATS to measure flush durations
+     */
+    uint32_t (*Timestamp)(void);
+    /**
+     * Optional RAM readback for HT1620Scrub(), with bit level PinSck/PinMosi only.
+     * PinRd drives the RD pin, PinData samples the DATA pin. DATA is the PinMosi line,
+     * PinDataDir switches it between input and output around the read
+     */
+    void (*PinRd)(bool);
+    bool (*PinData)(void);
+    /**
+     * Optional DMA transport, used instead of Transmit when set. Frame format is the one of Transmit.
+     * Starts the transfer and returns at once, the DMA complete interrupt calls HT1620TransmitDone().
+     * data stays untouched until then
+     */
+    void (*TransmitAsync)(const uint8_t *data, uint8_t size, uint16_t bits);
+    /**
+     * Optional, needed by HT1620Scrub(): DATA pin direction. Called with true before the first
+     * RD edge, the chip drives DATA from then on, and with false after the frame
+     */
+    void (*PinDataDir)(bool input);
 } HT1620_HAL_st;
 
+typedef struct HT1620_Bus_st
+{
+    struct HT1620_ctx *owner;   // display transmitting a frame now
+    struct HT1620_ctx *waiting; // DMA display with a frame waiting for owner, started when owner runs empty
+} HT1620_Bus_st;
+
+/**
+ * Bus timing in nanoseconds. Delays used by the driver are derived once,
+ * on HT1620Init() or HT1620SetTiming()
+ */
+typedef struct
+{
+    uint16_t ClkLowNs;  // WR low pulse width
+    uint16_t ClkHighNs; // WR high pulse width
+    uint16_t SetupNs;   // DATA setup before WR rising edge
+    uint16_t HoldNs;    // DATA hold after WR rising edge
+    uint16_t CsSetupNs; // CS falling edge to first WR edge
+    uint16_t CsHoldNs;  // last WR edge to CS rising edge
+    uint16_t CsHighNs;  // CS high time between frames
+    uint16_t RdLowNs;   // RD low pulse width, DATA is valid at its end
+    uint16_t RdHighNs;  // RD high pulse width
+} HT1620_Timing_st;
+
+// HT1621 datasheet limits, in nanoseconds. WR and RD pulses depend on the supply, low and high alike
+#define HT1620_3V_CLK_NS 3340
+#define HT1620_3V_RD_NS 6670
+#define HT1620_5V_CLK_NS 1670
+#define HT1620_5V_RD_NS 3340
+#define HT1620_SETUP_NS 120
+#define HT1620_HOLD_NS 120
+#define HT1620_CS_SETUP_NS 100
+#define HT1620_CS_HOLD_NS 100
+#define HT1620_CS_HIGH_NS 250
+
+// profiles of these limits for 3V and 5V supply
+extern const HT1620_Timing_st HT1620_TIMING_3V;
+extern const HT1620_Timing_st HT1620_TIMING_5V;
+
+typedef struct
+{
+    uint8_t data[DISPLAY_BUFFER_SIZE];
+    uint16_t bits;
+} HT1620_TxFrame_st;
+
+#ifdef HT1620_STATS
+typedef struct
+{
+    uint32_t frames;         // chip select frames sent
+    uint32_t bits;           // bits clocked, block transfer padding included
+    uint32_t commands;       // driver commands sent
+    uint32_t flushes;        // flushes that found changes
+    uint32_t flushesSkipped; // flushes without changes, nothing sent
+    uint32_t addrSkipped;    // RAM addresses (4 bits each) change detection left out of flushes
+    uint32_t addrScrubbed;   // RAM addresses read back by HT1620Scrub()
+    uint32_t addrRepaired;   // read back addresses that differed and were rewritten
+    /**
+     * Flush durations in HAL Timestamp() units, from the flush call until its last frame is sent.
+     * Asynchronous flushes queued before the previous one is sent are timed as one.
+     * Bucket 0 holds 0, bucket i holds [2^(i-1), 2^i), the last bucket holds everything longer
+     */
+    uint32_t flushTime[HT1620_STATS_BUCKETS];
+} HT1620_Stats_st;
+#endif
+
+#ifdef HT1620_ENERGY
+/**
+ * Energy model of the display for charge estimates. Values depend on the board: measure
+ * them for real budgets, HT1620_ENERGY_3V is a starting point
+ */
+typedef struct
+{
+    uint32_t EdgePc;      // charge of one WR, RD or CS edge: line and pin capacitance times VDD, data line on average
+    uint32_t CommandPc;   // extra charge of one driver command
+    uint32_t LcdOnNa;     // driver supply current with oscillator and bias generator on
+    uint32_t TimestampNs; // length of one HAL Timestamp() unit, needed for the LCD on part
+} HT1620_Energy_st;
+
+// HT1621 at 3V with the on-chip RC oscillator, 20 pF bus lines, microsecond Timestamp()
+extern const HT1620_Energy_st HT1620_ENERGY_3V;
+
+// estimated charge drawn by the display, in picocoulombs (1 uAh = 3.6e9 pC)
+typedef struct
+{
+    uint64_t busPc;     // bus edges of frames sent and read
+    uint64_t commandPc; // driver commands
+    uint64_t lcdOnPc;   // time with the LCD on
+    uint64_t totalPc;
+} HT1620_Charge_st;
+#endif
+
+/**
+ * Page of HT1620Carousel(): a render callback or a ready frame, shown for dwell ticks
+ */
+typedef struct
+{
+    void (*render)(struct HT1620_ctx *ctx, void *arg); // draws the page into a blank buffer, 0 to use frame
+    void *arg;                                         // passed to render
+    const uint8_t *frame;                              // DISPLAY_BUFFER_SIZE bytes in the layout of buffer
+    uint16_t dwell;                                    // HT1620CarouselTick() calls the page stays, 0 is taken as 1
+} HT1620_Page_st;
+
+#ifdef HT1620_UPDATE_QUEUE_LEN
+typedef enum
+{
+    HT1620_UPD_NUM,     // HT1620printNum(value)
+    HT1620_UPD_FIXED,   // HT1620printFixed(value, arg)
+    HT1620_UPD_BATTERY, // HT1620batteryLevel(value)
+    HT1620_UPD_SIGNAL,  // HT1620SignalLevel(value)
+    HT1620_UPD_SYMBOLS, // HT1620SetSymbols(on, off)
+} HT1620_UpdateOp_e;
+
+/**
+ * Display change posted by HT1620Post()
+ */
+typedef struct
+{
+    uint8_t op; // HT1620_UpdateOp_e
+    int32_t value;
+    uint32_t arg;
+    uint64_t on;
+    uint64_t off;
+} HT1620_Update_st;
+
+typedef struct
+{
+    atomic_uint_least32_t seq; // position the cell is free for (pos) or published at (pos + 1)
+    HT1620_Update_st update;
+} HT1620_UpdateCell_st;
+#endif
+
+#ifdef HT1620_FRAME_CACHE_SIZE
+typedef struct
+{
+    uint16_t screen;
+    int32_t value;
+    bool valid;
+    uint8_t frame[DISPLAY_BUFFER_SIZE]; // buffer as it was stored
+} HT1620_CachedFrame_st;
+#endif
+
+// bus delays kept by the driver, internal
+typedef enum
+{
+    HT1620_DELAY_NONE,
+    HT1620_DELAY_CLK_LOW,       // data is set at the falling edge: low phase covers data setup
+    HT1620_DELAY_CLK_HIGH,      // next falling edge changes data: high phase covers data hold
+    HT1620_DELAY_CLK_HIGH_LAST, // high phase of the last bit, covers chip select hold as well
+    HT1620_DELAY_CS_SETUP,
+    HT1620_DELAY_CS_HOLD,
+    HT1620_DELAY_CS_HIGH,
+    HT1620_DELAY_RD_LOW,
+    HT1620_DELAY_RD_HIGH,
+    HT1620_DELAY_COUNT
+} HT1620_Delay_e;
+
+/**
+ * One display. All fields are internal, use the API functions.
+ * Any number of contexts may exist, each one drives its own HT1621
+ */
+typedef struct HT1620_ctx
+{
+    uint8_t buffer[DISPLAY_BUFFER_SIZE];   // display data, write frame in transmission order. Header bits are left 0, flushes never change them
+    uint8_t shadow[DISPLAY_BUFFER_SIZE];   // buffer as of the last flush: what the driver RAM holds
+    uint32_t ramDirty;                     // addresses to be rewritten regardless of shadow
+    bool lcdOn;                            // last state set by HT1620displayOn()/HT1620displayOff()
+    uint8_t updateDepth;                   // open HT1620BeginUpdate() calls, flush is deferred while not 0
+    const HT1620_HAL_st *hal;
+    const HT1620_Timing_st *timing;
+
+    // bus delays, derived from timing once: ns for DelayNs(), loop rounds for the busy wait without it
+    struct
+    {
+        uint32_t ns[HT1620_DELAY_COUNT];
+        uint32_t loops[HT1620_DELAY_COUNT];
+    } busDelay;
+
+    // frames waiting for the bus. Blocking mode sends every frame right after it is queued,
+    // asynchronous mode leaves them to HT1620Tick() or the DMA interrupt (HT1620TransmitDone()).
+    // Fields the interrupt changes are volatile
+    struct
+    {
+        HT1620_TxFrame_st frame[HT1620_TX_QUEUE_LEN];
+        uint8_t front[DISPLAY_BUFFER_SIZE];     // frame of the flush postponed by flushPending
+        volatile uint8_t head;                  // frame on the bus
+        volatile uint8_t count;                 // queued frames including the one on the bus
+        volatile uint16_t step;                 // bus edge of the head frame: CS falling, 2 per bit, CS rising
+        bool async;
+        volatile bool flushPending;             // flush found the queue full, HT1620Tick() or HT1620TransmitDone() retries it
+        volatile bool dmaBusy;                  // TransmitAsync() transfer of the head frame in progress
+        volatile uint8_t lock;                  // queue changes in progress, HT1620TransmitDone() leaves the next frame to them
+        void (*done)(struct HT1620_ctx *);      // called when the queue is empty again
+        void (*flushDone)(struct HT1620_ctx *); // HT1620FlushAsync() callback, called once
+    } tx;
+
+    // marquee started by HT1620Scroll(), stepped by HT1620ScrollTick()
+    struct
+    {
+        const char *text; // 0 while not scrolling
+        uint16_t len;
+        uint16_t pos;    // text index shown in the leftmost digit, plus DISPLAY_SIZE
+        uint16_t period; // ticks per step
+        uint16_t ticks;  // ticks since the last step
+    } scroll;
+
+    // blinking segments, set by HT1620BlinkSymbols()/HT1620BlinkDigits(), stepped by HT1620BlinkTick()
+    struct
+    {
+        uint8_t mask[DISPLAY_BUFFER_SIZE]; // segments hidden in the off phase, layout of buffer
+        uint16_t period;                   // ticks per phase
+        uint16_t ticks;                    // ticks since the last phase change
+        bool off;                          // masked segments are not sent while set
+    } blink;
+
+    uint8_t scrubAddr; // RAM address the next HT1620Scrub() starts from
+
+    // pages rotated by HT1620CarouselTick()
+    struct
+    {
+        const HT1620_Page_st *pages; // 0 while stopped
+        uint8_t count;
+        uint8_t current;
+        uint16_t ticks; // ticks the current page is shown
+    } carousel;
+
+#ifdef HT1620_STATS
+    HT1620_Stats_st stats;
+    uint32_t flushStart; // Timestamp() of the flush being sent
+    bool flushTimed;     // flushStart is valid
+#endif
+
+#ifdef HT1620_ENERGY
+    const HT1620_Energy_st *energy;
+    HT1620_Charge_st charge;
+    uint32_t lcdOnSince; // Timestamp() up to which LCD on time is accounted
+#endif
+
+#ifdef HT1620_FRAME_CACHE_SIZE
+    HT1620_CachedFrame_st cache[HT1620_FRAME_CACHE_SIZE]; // slot per screen ID
+#endif
+
+#ifdef HT1620_UPDATE_QUEUE_LEN
+    // bounded ring: any number of producers, HT1620FlushUpdates() is the only consumer
+    struct
+    {
+        HT1620_UpdateCell_st cell[HT1620_UPDATE_QUEUE_LEN];
+        // tail, head, cell seq and positions share one type, so all of them wrap at the same point
+        atomic_uint_least32_t tail; // next position to post to
+        uint_least32_t head;        // next position to take, consumer only
+    } updates;
+#endif
+} HT1620_ctx;
+
 /**
      * @brief Construct a new HT1621 object
      *
      * Starts the lcd with the pin assignment declared. The backlight pin is optional
-     *  
-     * @param hal_ptr 
+     *
+     * @param ctx - display context to initialize. Every other function takes it as the first parameter
+     * @param hal_ptr - pins of this display. Must stay valid while the context is used
+     */
+void HT1620Init(HT1620_ctx *ctx, const HT1620_HAL_st *hal_ptr);
+
+/**
+     * @brief Selects bus timing profile. HT1620_TIMING_3V is used by default
+     *
+     * @param timing - one of HT1620_TIMING_3V, HT1620_TIMING_5V or custom profile
+     */
+void HT1620SetTiming(HT1620_ctx *ctx, const HT1620_Timing_st *timing);
+
+/**
+     * @brief Switches between blocking and asynchronous transmission. Blocking is the default
+     *
+     * In asynchronous mode flushes and commands are only queued and HT1620Tick() moves them
+     * to the bus. Switching back to blocking mode sends everything still queued.
+     *
+     * @param enable - true for asynchronous mode
+     * @param done - optional, called from HT1620Tick() when the last queued frame is sent
+     */
+void HT1620SetAsync(HT1620_ctx *ctx, bool enable, void (*done)(HT1620_ctx *ctx));
+
+/**
+     * @brief Advances asynchronous transmission
+     *
+     * Call it from a timer interrupt or main loop tick. The tick period is the bus clock phase,
+     * so it must be at least as long as the selected timing profile requires. HT1620Tick()
+     * must not preempt other HT1620 calls: mask the timer interrupt around them.
+     *
+     * @param edges - max number of bus edges (clock or chip select) to make in this call.
+     *                Edges before the last one are spaced by DelayNs(), the tick period
+     *                follows the last one
+     * @return HT1620Busy() result
+     */
+bool HT1620Tick(HT1620_ctx *ctx, uint16_t edges);
+
+/**
+     * @brief Checks whether asynchronous transmission is still in progress
+     */
+bool HT1620Busy(HT1620_ctx *ctx);
+
+/**
+     * @brief Sends the buffer changes in the background and returns at once
+     *
+     * Switches to asynchronous mode. Changes are copied into the transmit queue (or into a front
+     * frame while the queue is full), so the buffer may be drawn again while they are sent.
+     * Sends even inside HT1620BeginUpdate(): keep an update open to draw whole frames into the
+     * buffer and hand them over with HT1620FlushAsync() only.
+     * With TransmitAsync in the HAL the DMA interrupt moves the frames through HT1620TransmitDone()
+     * and later flushes of the asynchronous mode start the bus as well, otherwise HT1620Tick() does.
+     *
+     * @param done - optional, called once when every frame of this flush is sent. A flush started
+     *               before that replaces it: its frames go after the earlier ones
+     * @return HT1620Busy() result
+     */
+bool HT1620FlushAsync(HT1620_ctx *ctx, void (*done)(HT1620_ctx *ctx));
+
+/**
+     * @brief Ends the frame sent by TransmitAsync(). Call it from the DMA complete interrupt
+     *
+     * In asynchronous mode starts the next queued frame, so a flush runs to its end from the interrupt.
+     * It may preempt other HT1620 calls: a transfer that ends while they change the queue (or wait
+     * for it in blocking mode) is taken over by them. A flush postponed by a full queue is retried
+     * from here with the frame of that flush.
+     */
+void HT1620TransmitDone(HT1620_ctx *ctx);
+
+/**
+     * @brief Starts a batch of display changes.
+     *
+     * Print functions called until the matching HT1620Commit() only change the buffer,
+     * so a whole screen (value, units, icons, battery) goes to the display in one flush.
+     * Calls may be nested, the flush happens on the outermost HT1620Commit()
      */
-void HT1620Init(HT1620_HAL_st *hal_ptr);
+void HT1620BeginUpdate(HT1620_ctx *ctx);
+
+/**
+     * @brief Ends a batch started by HT1620BeginUpdate() and sends the changes to the display.
+     * Without an open batch it just flushes, e.g. after HT1620Disp* symbol changes
+     */
+void HT1620Commit(HT1620_ctx *ctx);
+
+#ifdef HT1620_STATS
+/**
+     * @brief Bus traffic counters of the display since HT1620Init() or HT1620ResetStats()
+     */
+const HT1620_Stats_st *HT1620GetStats(HT1620_ctx *ctx);
+
+/**
+     * @brief Zero the counters, e.g. at the start of every reporting period
+     */
+void HT1620ResetStats(HT1620_ctx *ctx);
+#endif
+
+#ifdef HT1620_ENERGY
+/**
+     * @brief Selects the energy model. HT1620_ENERGY_3V is used by default
+     */
+void HT1620SetEnergyModel(HT1620_ctx *ctx, const HT1620_Energy_st *model);
+
+/**
+     * @brief Charge drawn by the display since HT1620Init() or HT1620ResetCharge(), up to now.
+     *
+     * Charge of a single call is the difference of totalPc before and after it (in asynchronous
+     * mode after HT1620Busy() is false). LCD on time needs the HAL Timestamp() hook and is
+     * accounted up to now on every call: call it at least once per Timestamp() wrap-around
+     */
+const HT1620_Charge_st *HT1620GetCharge(HT1620_ctx *ctx);
+
+/**
+     * @brief Zero the charge, e.g. at the start of every reporting period
+     */
+void HT1620ResetCharge(HT1620_ctx *ctx);
+#endif
+
+/**
+     * @brief Rewrites driver configuration and the whole RAM, even if nothing has changed.
+     *
+     * Flushes send only what differs from the last flush. Use this one when the driver
+     * may have lost its state, e.g. after an ESD event or a brown-out of the display supply
+     */
+void HT1620Refresh(HT1620_ctx *ctx);
+
+/**
+     * @brief Reads back a chunk of driver RAM and rewrites the addresses that differ.
+     *
+     * Repairs RAM corrupted by ESD without a full rewrite: a clean chunk costs one read
+     * frame of 9 + 4 * count bits. Successive calls go on from where the last one stopped,
+     * e.g. 4 addresses per second cover the RAM every 8 seconds. Queued frames are sent first.
+     * Needs PinRd, PinData and PinDataDir in the HAL, does nothing without them.
+     *
+     * @param count - addresses to check, up to HT1620_RAM_SIZE
+     * @return number of addresses found corrupted
+     */
+uint8_t HT1620Scrub(HT1620_ctx *ctx, uint8_t count);
+
+#ifdef HT1620_FRAME_CACHE_SIZE
+/**
+     * @brief Shows a screen encoded before, without formatting it again.
+     *
+     * Screen screen % HT1620_FRAME_CACHE_SIZE keeps the frame of its last stored value:
+     * with screen IDs below the cache size no screen evicts another one. On a hit the
+     * frame replaces the buffer, scrolling is stopped and
+     * the usual flush sends what differs. On a miss nothing changes: render the screen and
+     * store it with HT1620CacheStore()
+     *
+     * @param screen - caller defined screen ID, e.g. energy, flow, serial
+     * @param value - value shown on the screen
+     * @return true on a hit
+     */
+bool HT1620CacheShow(HT1620_ctx *ctx, uint16_t screen, int32_t value);
+
+/**
+     * @brief Stores the buffer as the frame of the screen and value
+     */
+void HT1620CacheStore(HT1620_ctx *ctx, uint16_t screen, int32_t value);
+
+/**
+     * @brief Forgets all stored frames, e.g. after the screen layout has changed
+     */
+void HT1620CacheClear(HT1620_ctx *ctx);
+#endif
+
+#ifdef HT1620_UPDATE_QUEUE_LEN
+/**
+     * @brief Posts a display change without touching the buffer or the bus.
+     *
+     * Lock-free and safe from any number of interrupts and tasks at once, e.g. pulse counter
+     * ISR, radio task and button handler. HT1620FlushUpdates() applies the change later.
+     * Needs atomic compare-and-swap. On cores without it (Cortex-M0, armv6-m) gcc emits
+     * calls to __atomic_compare_exchange_4, which bare-metal runtimes lack: build with
+     * HT1620_NO_CAS and the critical section macros, the position is then claimed with
+     * interrupts masked for a few instructions.
+     *
+     * @return false when the queue is full, the update is dropped
+     */
+bool HT1620Post(HT1620_ctx *ctx, const HT1620_Update_st *update);
+
+/**
+     * @brief Applies every posted update in a single flush. Call it from one task only.
+     *
+     * Updates are coalesced first: the latest value, battery and signal level win,
+     * symbol changes are merged in order. Battery and signal segments end up as posted
+     * last, by a level or by a symbol change. Other calls must not run at the same time.
+     *
+     * @return number of updates taken from the queue
+     */
+uint16_t HT1620FlushUpdates(HT1620_ctx *ctx);
+#endif
+
+/**
+     * @brief Sends driver commands. Up to 15 commands share one chip select frame
+     *
+     * @param cmds - HT1620_CMD_* codes
+     * @param count - number of commands
+     */
+void HT1620WriteCmds(HT1620_ctx *ctx, const uint8_t *cmds, uint8_t count);
 
 /**
      * @brief Turns on the display (doesn't affect the backlight)
+     *
+     * Sends SYSEN and LCDON: the system oscillator is started again before the bias generator.
+     * Earlier versions sent LCDON only
      */
-void HT1620displayOn();
+void HT1620displayOn(HT1620_ctx *ctx);
 
 /**
      * @brief Turns off the display (doesn't affect the backlight)
+     *
+     * Sends LCDOFF and SYSDIS, earlier versions sent LCDOFF only. SYSDIS stops the system oscillator,
+     * so the time base, the WDT and tone outputs stop as well. RAM content is kept
      */
-void HT1620displayOff();
+void HT1620displayOff(HT1620_ctx *ctx);
 
 /**
      * @brief Show battery level.
      *
      * @param percents - battery charge state. May vary from 0 up to 100
      */
-void HT1620batteryLevel(uint8_t percents);
+void HT1620batteryLevel(HT1620_ctx *ctx, uint8_t percents);
 
 /**
-     * @brief Print string (up to 6 characters)
+     * @brief Print string (up to DISPLAY_SIZE characters, the rest is cut off)
      *
      * @param str String to be displayed.
      * Allowed: letters, digits, space, minus, underscore
      * Not allowed symbols will be displayed as spaces. See symbols appearance in README.md
      */
-void HT1620printStr(const char *str);
+void HT1620printStr(HT1620_ctx *ctx, const char *str);
+
+/**
+     * @brief Scrolls a string longer than the glass from right to left
+     *
+     * The text starts left aligned, moves one digit per step, leaves the glass and enters
+     * it again from the right. Decimal dots are cleared when scrolling starts. Steps rewrite
+     * digit segments only, battery and icons set before are kept. The glass shares the
+     * A segment of digits 0 to 3 with the MAX(en), minus, MIN(ru) and MIN(en) icons, and of
+     * digits 4 to 8 with the dots: these follow the text and are resent with their digits.
+     * A text that fits is just printed.
+     * Any print function or HT1620clear() stops scrolling.
+     *
+     * @param text - string to scroll, same characters as HT1620printStr(). Not copied:
+     * must stay valid until scrolling is stopped
+     * @param period - HT1620ScrollTick() calls per step, 0 is taken as 1
+     */
+void HT1620Scroll(HT1620_ctx *ctx, const char *text, uint16_t period);
 
 /**
-     * @brief Prints a signed integer between -99999 and 999999.
-     * Larger and smaller values will be displayed as -99999 and 999999
+     * @brief Advances scrolling. Call it with a fixed period, e.g. from the main loop tick
+     *
+     * @return true while scrolling
+     */
+bool HT1620ScrollTick(HT1620_ctx *ctx);
+
+/**
+     * @brief Stops scrolling, the current step stays on the glass
+     */
+void HT1620ScrollStop(HT1620_ctx *ctx);
+
+/**
+     * @brief Rotates pages on a tick, e.g. energy, flow and temperature screens of a meter.
+     *
+     * Every page is drawn as a whole into a blank buffer, by its render callback or from
+     * its frame, and goes to the display in one flush of the segments that differ from
+     * the previous page: no clear() in between. Shows the first page right away.
+     *
+     * @param pages - must stay valid until the carousel is stopped
+     * @param count - number of pages
+     */
+void HT1620Carousel(HT1620_ctx *ctx, const HT1620_Page_st *pages, uint8_t count);
+
+/**
+     * @brief Advances the carousel. Call it with a fixed period, e.g. from the main loop tick
+     *
+     * @return true while the carousel runs
+     */
+bool HT1620CarouselTick(HT1620_ctx *ctx);
+
+/**
+     * @brief Stops the carousel, the current page stays on the glass
+     */
+void HT1620CarouselStop(HT1620_ctx *ctx);
+
+/**
+     * @brief Prints a signed integer right aligned to 6 digits, longer numbers take up to
+     * DISPLAY_SIZE digits: -99999999 to 999999999. Larger values are clamped to 999999999,
+     * smaller ones don't fit the glass
      *
      * @param num - number to be printed
      */
-void HT1620printNum(int32_t num);
+void HT1620printNum(HT1620_ctx *ctx, int32_t num);
 
 /**
-     * @brief Prints a float with 0 to 3 decimals, based on the `precision` parameter. Default value is 3
-     * This method may be slow on many systems. Try to avoid float usage.
-     * You may use `void print(int32_t multiplied_float, uint32_t multiplier)` instead
+     * @brief Prints a float with 0 to 5 decimals, based on the `precision` parameter, rounded to nearest.
+     * Float is converted with integer operations only, no FPU or soft-float math is needed.
+     * You may use `HT1620printFixed(int32_t multiplied_float, uint32_t multiplier)` instead
      *
      * @param num  - number to be printed
      * @param precision - precision of the number
      */
-void HT1620printFloat(float num, uint8_t precision);
+void HT1620printFloat(HT1620_ctx *ctx, float num, uint8_t precision);
 
 /**
      * @brief Prints number with dot. Use it instead float. Float type usage may slow down many systems
      */
-void HT1620printFixedPoint(int32_t multiplied_float, uint32_t multiplier);
+void HT1620printFixed(HT1620_ctx *ctx, int32_t multiplied_float, uint32_t multiplier);
 
 /**
      * @brief Clears the display
      */
-void HT1620clear();
+void HT1620clear(HT1620_ctx *ctx);
+
+/**
+ * Glass icons for HT1620SetSymbols(). _RU and _EN are the russian and english
+ * variants of the same icon
+ */
+typedef enum
+{
+    HT1620_SYM_MIN_RU,
+    HT1620_SYM_MAX_RU,
+    HT1620_SYM_MIN_EN,
+    HT1620_SYM_MAX_EN,
+    HT1620_SYM_BURST_RU,
+    HT1620_SYM_BURST_EN,
+    HT1620_SYM_LEAK_RU,
+    HT1620_SYM_LEAK_EN,
+    HT1620_SYM_REV_RU,
+    HT1620_SYM_REV_EN,
+    HT1620_SYM_FROST,
+    HT1620_SYM_Q,
+    HT1620_SYM_VER_RU,
+    HT1620_SYM_VER_EN,
+    HT1620_SYM_SN_RU,
+    HT1620_SYM_SN_EN,
+    HT1620_SYM_WARN,
+    HT1620_SYM_MAGNET,
+    HT1620_SYM_LEFT,
+    HT1620_SYM_RIGHT,
+    HT1620_SYM_NOWATER,
+    HT1620_SYM_CRC,
+    HT1620_SYM_DELTA,
+    HT1620_SYM_T,
+    HT1620_SYM_T1,
+    HT1620_SYM_T2,
+    HT1620_SYM_NBFI,
+    HT1620_SYM_NBIOT,
+    HT1620_SYM_DEGREE,
+    HT1620_SYM_GCAL,
+    HT1620_SYM_GCAL_H,
+    HT1620_SYM_GJ,
+    HT1620_SYM_GJ_H,
+    HT1620_SYM_KW,
+    HT1620_SYM_MW,
+    HT1620_SYM_W,
+    HT1620_SYM_WH,
+    HT1620_SYM_GAL,
+    HT1620_SYM_GAL_PM,
+    HT1620_SYM_M3,
+    HT1620_SYM_M3_H,
+    HT1620_SYM_M3_H_EN,
+    HT1620_SYM_FT3,
+    HT1620_SYM_FT3_PM,
+    HT1620_SYM_MMBTU,
+    HT1620_SYM_GALLONS,
+    HT1620_SYM_US,
+    HT1620_SYM_BAT1,
+    HT1620_SYM_BAT2,
+    HT1620_SYM_BAT3,
+    HT1620_SYM_BAT4,
+    HT1620_SYM_SIG1,
+    HT1620_SYM_SIG2,
+    HT1620_SYM_SIG3,
+    HT1620_SYM_COUNT
+} HT1620_Symbol_e;
+
+// mask bit of the symbol for HT1620SetSymbols()
+#define HT1620_SYM(S) (1ULL << (S))
+
+/**
+     * @brief Switches many icons at once, e.g. a whole status word mapped to icons.
+     *
+     * Icons of on are shown, icons of off are hidden, the rest stay as they are.
+     * An icon in both masks is shown, bits from HT1620_SYM_COUNT up are ignored, so
+     * (0, ~0ULL) hides every icon. Like HT1620Disp* it only changes the buffer,
+     * send it with HT1620Commit()
+     *
+     * @param on - HT1620_SYM() bits of icons to show
+     * @param off - HT1620_SYM() bits of icons to hide
+     */
+void HT1620SetSymbols(HT1620_ctx *ctx, uint64_t on, uint64_t off);
+
+/**
+     * @brief Makes icons blink or stop blinking. Icons blink only while they are shown.
+     *
+     * The driver has no blink of its own: HT1620BlinkTick() hides the blinking segments
+     * every other phase and flushes only the addresses that hold them. The buffer keeps
+     * them, so printing and icon changes go on as usual while blinking.
+     *
+     * @param on - HT1620_SYM() bits of icons to blink
+     * @param off - HT1620_SYM() bits of icons to stop blinking
+     */
+void HT1620BlinkSymbols(HT1620_ctx *ctx, uint64_t on, uint64_t off);
+
+/**
+     * @brief Selects blinking digits, e.g. the one being edited. Replaces the previous selection
+     *
+     * @param digits - bit i set makes digit i blink, digit 0 is the leftmost one. 0 stops digits blinking
+     */
+void HT1620BlinkDigits(HT1620_ctx *ctx, uint16_t digits);
+
+/**
+     * @brief Sets blink phase length
+     *
+     * @param period - HT1620BlinkTick() calls per on or off phase, 0 is taken as 1
+     */
+void HT1620SetBlinkPeriod(HT1620_ctx *ctx, uint16_t period);
+
+/**
+     * @brief Advances blinking. Call it with a fixed period, e.g. from the main loop tick
+     *
+     * @return true while something blinks
+     */
+bool HT1620BlinkTick(HT1620_ctx *ctx);
 
 /*!
     * \brief display min or max value
@@ -112,7 +822,7 @@ void HT1620clear();
     * \param mode true if russian or false if english symbols
     * \param min true if display min, false if display max
     */
-void HT1620DispMinMax(bool enable, bool mode, bool min);
+void HT1620DispMinMax(HT1620_ctx *ctx, bool enable, bool mode, bool min);
 
 /*!
     * \brief display burst or proriv
@@ -120,7 +830,7 @@ void HT1620DispMinMax(bool enable, bool mode, bool min);
     * \param enable true for enable symbols, false for disable all symbols
     * \param mode true if russian or false if english symbols
     */
-void HT1620DispBurst(bool enable, bool mode);
+void HT1620DispBurst(HT1620_ctx *ctx, bool enable, bool mode);
 
 /*!
     * \brief display leak or TEch`
@@ -128,7 +838,7 @@ void HT1620DispBurst(bool enable, bool mode);
     * \param enable true for enable symbols, false for disable all symbols
     * \param mode true if russian or false if english symbols
     */
-void HT1620DispLeak(bool enable, bool mode);
+void HT1620DispLeak(HT1620_ctx *ctx, bool enable, bool mode);
 
 /*!
     * \brief display reverse or obr
@@ -136,21 +846,21 @@ void HT1620DispLeak(bool enable, bool mode);
     * \param enable true for enable symbols, false for disable all symbols
     * \param mode true if russian or false if english symbols
     */
-void HT1620DispRev(bool enable, bool mode);
+void HT1620DispRev(HT1620_ctx *ctx, bool enable, bool mode);
 
 /*!
     * \brief display snowflake frost symbol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispFrost(bool enable);
+void HT1620DispFrost(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display snowflake frost symbol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispQ(bool enable);
+void HT1620DispQ(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display version or no
@@ -158,7 +868,7 @@ void HT1620DispQ(bool enable);
     * \param enable true for enable symbols, false for disable all symbols
     * \param mode true if russian or false if english symbols
     */
-void HT1620DispVer(bool enable, bool mode);
+void HT1620DispVer(HT1620_ctx *ctx, bool enable, bool mode);
 
 /*!
     * \brief display serial number or B
@@ -166,103 +876,103 @@ void HT1620DispVer(bool enable, bool mode);
     * \param enable true for enable symbols, false for disable all symbols
     * \param mode true if russian or false if english symbols
     */
-void HT1620DispSN(bool enable, bool mode);
+void HT1620DispSN(HT1620_ctx *ctx, bool enable, bool mode);
 
 /*!
     * \brief display warning sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispWarn(bool enable);
+void HT1620DispWarn(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display magnet sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispMagn(bool enable);
+void HT1620DispMagn(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display left sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispLeft(bool enable);
+void HT1620DispLeft(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display right sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispRight(bool enable);
+void HT1620DispRight(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display no water sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispNoWater(bool enable);
+void HT1620DispNoWater(HT1620_ctx *ctx, bool enable);
 /*!
     * \brief display CRC symbol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispCRC(bool enable);
+void HT1620DispCRC(HT1620_ctx *ctx, bool enable);
 /*!
     * \brief display delta symbol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispDelta(bool enable);
+void HT1620DispDelta(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display T symbol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispT(bool enable);
+void HT1620DispT(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display 1 sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620Disp1(bool enable);
+void HT1620Disp1(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display T2 sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispT2(bool enable);
+void HT1620DispT2(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display NBFI radio sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispNBFi(bool enable);
+void HT1620DispNBFi(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display NB-iot radio sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispNBIoT(bool enable);
+void HT1620DispNBIoT(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display level of signal
     *
     * \param percents if 0 - no display, 0--30 one segment, 30--60 two segments, more than 60 - 3 segments
     */
-void HT1620SignalLevel(uint8_t percents);
+void HT1620SignalLevel(HT1620_ctx *ctx, uint8_t percents);
 
 /*!
     * \brief display DegreePoint sybmol
     *
     * \param enable true for enable symbols, false for disable all symbols
     */
-void HT1620DispDegreePoint(bool enable);
+void HT1620DispDegreePoint(HT1620_ctx *ctx, bool enable);
 
 /*!
     * \brief display energy in GJ or Kkal
@@ -271,7 +981,7 @@ void HT1620DispDegreePoint(bool enable);
     * \param mode true if Kkal or false if GJ symbols
     * \param perH true for display per hour symbol
     */
-void HT1620DispEnergyJ(bool enable, bool mode, bool perH);
+void HT1620DispEnergyJ(HT1620_ctx *ctx, bool enable, bool mode, bool perH);
 
 /*!
     * \brief display energy in MkWh
@@ -280,7 +990,7 @@ void HT1620DispEnergyJ(bool enable, bool mode, bool perH);
     * \param M if true than display MW else display kW
     * \param perH if true than display Wh else display W
     */
-void HT1620DispEnergyW(bool enable, bool M, bool perH);
+void HT1620DispEnergyW(HT1620_ctx *ctx, bool enable, bool M, bool perH);
 
 /*!
     * \brief display flow in m3 per hour
@@ -289,7 +999,7 @@ void HT1620DispEnergyW(bool enable, bool M, bool perH);
     * \param mode if true than display per chas else display per hour
     * \param perH if true than display per time else display only volume
     */
-void HT1620DispFlowM3(bool enable, bool mode, bool perH);
+void HT1620DispFlowM3(HT1620_ctx *ctx, bool enable, bool mode, bool perH);
 
 /*!
      * \brief display flow in GAL per min
@@ -297,7 +1007,7 @@ void HT1620DispFlowM3(bool enable, bool mode, bool perH);
      * \param enable true for enable symbols, false for disable all symbols
      * \param perH if true than display per minute else display only volume
      */
-void HT1620DispFlowGAL(bool enable, bool perH);
+void HT1620DispFlowGAL(HT1620_ctx *ctx, bool enable, bool perH);
 
 /*!
      * \brief display flow in FT3 per min
@@ -305,14 +1015,14 @@ void HT1620DispFlowGAL(bool enable, bool perH);
      * \param enable true for enable symbols, false for disable all symbols
      * \param perH if true than display per minute else display only volume
      */
-void HT1620DispFlowFT(bool enable, bool perH);
+void HT1620DispFlowFT(HT1620_ctx *ctx, bool enable, bool perH);
 
 /*!
      * \brief display britan meter unit for heat
      *
      * \param enable true for enable symbols, false for disable all symbols
      */
-void HT1620DispMMBTU(bool enable);
+void HT1620DispMMBTU(HT1620_ctx *ctx, bool enable);
 
 /*!
      * \brief display u.s. gallons or gallons
@@ -320,15 +1030,14 @@ void HT1620DispMMBTU(bool enable);
      * \param enable true for enable symbols, false for disable all symbols
      * \param mode if true then display U.S. else display only GALLONS
      */
-void HT1620DispGal(bool enable, bool mode);
-
-#define DISPLAY_SIZE 9                             // 16 * 8  = 128 symbols on display plus 2 byte for address
-#define SYS_SIZE 2                                 // 2 byte for address and commands
-#define DATA_SIZE 16                               // 16 * 8  = 128 symbols on display
-#define DISPLAY_BUFFER_SIZE (DATA_SIZE + SYS_SIZE) //  plus 2 byte for address
+void HT1620DispGal(HT1620_ctx *ctx, bool enable, bool mode);
 
 // defines to set display pin to low or high level
 #define LOW 0
 #define HIGH 1
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
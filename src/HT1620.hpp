@@ -0,0 +1,249 @@
+/*******************************************************************************
+C++ front-end of the HT1620 library, header only. Needs C++11.
+
+HT1620<Transport, Timing> binds the bus at compile time. Pins are static inline
+functions of the Transport policy, typically direct GPIO register writes, and
+frames queued by the C library are clocked out by one Transmit() hook with the
+bit loop unrolled per byte. Only the bits of the frame reach the wire, the
+padding of the last byte is not clocked. The library then makes a few indirect
+calls per frame (chip select, delays, Transmit) instead of three per bit.
+
+Everything above the bus is the C API: the object converts to HT1620_ctx *,
+so any HT1620 function takes it as is. C units and C++ units must see the same
+feature flags, and HT1620_UPDATE_QUEUE_LEN (C11 atomics) is not available here.
+
+Example:
+
+    struct Bus
+    {
+        static void cs(bool level) { level ? GPIOB->BSRR = CS_Pin : GPIOB->BRR = CS_Pin; }
+        static void wr(bool level) { level ? GPIOB->BSRR = WR_Pin : GPIOB->BRR = WR_Pin; }
+        static void data(bool level) { level ? GPIOB->BSRR = DATA_Pin : GPIOB->BRR = DATA_Pin; }
+        static void delayNs(uint32_t ns) { (void)ns; } // 16 MHz core is slower than the bus
+    };
+
+    static HT1620<Bus, HT1620Timing5V> lcd;
+    lcd.init();
+    lcd.printNum(123456);
+    HT1620DispT(lcd, true);
+*******************************************************************************/
+
+#ifndef HT1620_HPP_
+#define HT1620_HPP_
+
+#include "HT1620.h"
+
+/**
+ * Bus timing policies, the compile time form of HT1620_TIMING_3V/5V.
+ * Custom profiles derive from one of them and hide the members they change
+ */
+struct HT1620Timing3V
+{
+    static constexpr uint16_t ClkLowNs = HT1620_3V_CLK_NS;
+    static constexpr uint16_t ClkHighNs = HT1620_3V_CLK_NS;
+    static constexpr uint16_t SetupNs = HT1620_SETUP_NS;
+    static constexpr uint16_t HoldNs = HT1620_HOLD_NS;
+    static constexpr uint16_t CsSetupNs = HT1620_CS_SETUP_NS;
+    static constexpr uint16_t CsHoldNs = HT1620_CS_HOLD_NS;
+    static constexpr uint16_t CsHighNs = HT1620_CS_HIGH_NS;
+    static constexpr uint16_t RdLowNs = HT1620_3V_RD_NS;
+    static constexpr uint16_t RdHighNs = HT1620_3V_RD_NS;
+};
+
+struct HT1620Timing5V : HT1620Timing3V
+{
+    static constexpr uint16_t ClkLowNs = HT1620_5V_CLK_NS;
+    static constexpr uint16_t ClkHighNs = HT1620_5V_CLK_NS;
+    static constexpr uint16_t RdLowNs = HT1620_5V_RD_NS;
+    static constexpr uint16_t RdHighNs = HT1620_5V_RD_NS;
+};
+
+/**
+ * Clocks bits 0..N-1 of byte out, least significant first. Recursion instead
+ * of a loop: every bit is straight line code with constant shift and delays
+ */
+template <class Transport, uint32_t LowNs, uint32_t HighNs, uint8_t N>
+struct HT1620Bits
+{
+    static inline void send(uint8_t byte)
+    {
+        HT1620Bits<Transport, LowNs, HighNs, N - 1>::send(byte);
+
+        // data is changed on falling edge, latched on rising
+        Transport::wr(LOW);
+        Transport::data((byte >> (N - 1)) & 1);
+        Transport::delayNs(LowNs);
+        Transport::wr(HIGH);
+        Transport::delayNs(HighNs);
+    }
+};
+
+template <class Transport, uint32_t LowNs, uint32_t HighNs>
+struct HT1620Bits<Transport, LowNs, HighNs, 0>
+{
+    static inline void send(uint8_t byte)
+    {
+        (void)byte;
+    }
+};
+
+/**
+ * One display on a compile time bus.
+ *
+ * Transport provides static void cs(bool), wr(bool), data(bool) for the CS, WR
+ * and DATA pins and static void delayNs(uint32_t), a busy wait that may be empty
+ * when the core is slower than the bus. Timing is HT1620Timing3V, HT1620Timing5V
+ * or a profile derived from them
+ */
+template <class Transport, class Timing = HT1620Timing3V>
+class HT1620
+{
+public:
+    /**
+     * @brief Starts the display, see HT1620Init()
+     */
+    void init()
+    {
+        HT1620Init(&ctx, hal());
+        HT1620SetTiming(&ctx, timing());
+    }
+
+    /**
+     * @brief Context for the rest of the C API
+     */
+    operator HT1620_ctx *()
+    {
+        return &ctx;
+    }
+
+    void printNum(int32_t num)
+    {
+        HT1620printNum(&ctx, num);
+    }
+
+    void printFloat(float num, uint8_t precision)
+    {
+        HT1620printFloat(&ctx, num, precision);
+    }
+
+    void printFixed(int32_t multiplied_float, uint32_t multiplier)
+    {
+        HT1620printFixed(&ctx, multiplied_float, multiplier);
+    }
+
+    void printStr(const char *str)
+    {
+        HT1620printStr(&ctx, str);
+    }
+
+    void clear()
+    {
+        HT1620clear(&ctx);
+    }
+
+    void batteryLevel(uint8_t percents)
+    {
+        HT1620batteryLevel(&ctx, percents);
+    }
+
+    void setSymbols(uint64_t on, uint64_t off)
+    {
+        HT1620SetSymbols(&ctx, on, off);
+    }
+
+    void displayOn()
+    {
+        HT1620displayOn(&ctx);
+    }
+
+    void displayOff()
+    {
+        HT1620displayOff(&ctx);
+    }
+
+    void beginUpdate()
+    {
+        HT1620BeginUpdate(&ctx);
+    }
+
+    void commit()
+    {
+        HT1620Commit(&ctx);
+    }
+
+private:
+    // the same derivation as the C driver: low phase covers data setup, high phase data hold
+    static constexpr uint32_t clkLow = Timing::ClkLowNs > Timing::SetupNs ? Timing::ClkLowNs : Timing::SetupNs;
+    static constexpr uint32_t clkHigh = Timing::ClkHighNs > Timing::HoldNs ? Timing::ClkHighNs : Timing::HoldNs;
+
+    static void transmit(const uint8_t *data, uint8_t size, uint16_t bits)
+    {
+        if (!size)
+            return;
+
+        for (uint8_t i = 0; i < size - 1; i++)
+            HT1620Bits<Transport, clkLow, clkHigh, 8>::send(data[i]);
+        tail(data[size - 1], bits - 8 * (size - 1));
+    }
+
+    // last byte of the frame, its padding bits are not clocked
+    static void tail(uint8_t byte, uint16_t bits)
+    {
+        switch (bits)
+        {
+        case 1: HT1620Bits<Transport, clkLow, clkHigh, 1>::send(byte); break;
+        case 2: HT1620Bits<Transport, clkLow, clkHigh, 2>::send(byte); break;
+        case 3: HT1620Bits<Transport, clkLow, clkHigh, 3>::send(byte); break;
+        case 4: HT1620Bits<Transport, clkLow, clkHigh, 4>::send(byte); break;
+        case 5: HT1620Bits<Transport, clkLow, clkHigh, 5>::send(byte); break;
+        case 6: HT1620Bits<Transport, clkLow, clkHigh, 6>::send(byte); break;
+        case 7: HT1620Bits<Transport, clkLow, clkHigh, 7>::send(byte); break;
+        default: HT1620Bits<Transport, clkLow, clkHigh, 8>::send(byte); break;
+        }
+    }
+
+    // PinSck/PinMosi stay set for the C driver, it only uses them when Transmit is missing
+    static HT1620_HAL_st halMake()
+    {
+        HT1620_HAL_st out = {}; // optional hooks stay nullptr
+        out.PinCs = Transport::cs;
+        out.PinSck = Transport::wr;
+        out.PinMosi = Transport::data;
+        out.Transmit = transmit;
+        out.DelayNs = Transport::delayNs;
+        return out;
+    }
+
+    // chip select delays of the C driver
+    static HT1620_Timing_st timingMake()
+    {
+        HT1620_Timing_st out = {};
+        out.ClkLowNs = Timing::ClkLowNs;
+        out.ClkHighNs = Timing::ClkHighNs;
+        out.SetupNs = Timing::SetupNs;
+        out.HoldNs = Timing::HoldNs;
+        out.CsSetupNs = Timing::CsSetupNs;
+        out.CsHoldNs = Timing::CsHoldNs;
+        out.CsHighNs = Timing::CsHighNs;
+        out.RdLowNs = Timing::RdLowNs;
+        out.RdHighNs = Timing::RdHighNs;
+        return out;
+    }
+
+    // built on first use, so a display started from a static constructor finds them ready
+    static const HT1620_HAL_st *hal()
+    {
+        static const HT1620_HAL_st built = halMake();
+        return &built;
+    }
+
+    static const HT1620_Timing_st *timing()
+    {
+        static const HT1620_Timing_st built = timingMake();
+        return &built;
+    }
+
+    HT1620_ctx ctx;
+};
+
+#endif //HT1620_HPP_
@@ -0,0 +1,24 @@
+/*******************************************************************************
+Number formatting of the library. Internal header, not a part of the API:
+shared by HT1620.c and the host tools, which check the encoders against
+snprintf() and floating point references.
+*******************************************************************************/
+
+#ifndef HT1620_FORMAT_H
+#define HT1620_FORMAT_H
+
+#include <stdint.h>
+
+#define MAX_NUM 999999999
+#define MIN_NUM -999999999
+
+// coverts buffer symbols to format, which can be displayed by lcd
+void bufferToAscii(const char *in, uint8_t *out);
+
+// put number digits right aligned into digit positions, the same way "%6li" would print it
+void numToSegments(int32_t num, uint8_t *out);
+
+// absolute value of float (given as raw bits) multiplied by 10^precision and rounded. Saturates at MAX_NUM
+uint32_t floatScale(uint32_t bits, uint8_t precision);
+
+#endif //HT1620_FORMAT_H
@@ -0,0 +1,176 @@
+/*******************************************************************************
+Segment layout of the glass driven by the library. Internal header, not a part
+of the API: shared by HT1620.c and the host tools.
+
+POS is the byte of the display buffer, SEG is the bit mask in this byte. The
+buffer holds the HT1621 write frame in transmission order, see HT1620.c.
+*******************************************************************************/
+
+#ifndef HT1620_LAYOUT_H
+#define HT1620_LAYOUT_H
+
+#define BAT1_SEG (1 << 5)
+#define BAT2_SEG (1 << 1)
+#define BAT3_SEG (1 << 2)
+#define BAT4_SEG (1 << 6)
+
+#define BAT14_POS 13
+#define BAT23_POS 14
+
+#define P1_SEG (1 << 0)
+#define P1_POS 7
+#define P2_SEG (1 << 0)
+#define P2_POS 8
+#define P3_SEG (1 << 0)
+#define P3_POS 9
+#define P4_SEG (1 << 0)
+#define P4_POS 10
+#define P5_SEG (1 << 0)
+#define P5_POS 11
+
+#define NUM1FGE_SEG (7 << 5) //0b11100000
+#define NUM1FGE_POS 2
+#define NUM1ABC_SEG (0x7 << 0) //0b00000111
+#define NUM1D_SEG (0x08 << 0)  //0b00001000
+#define NUM1ABCD_POS 3
+
+#define MINUS_SEG (1 << 0)
+#define MINUS_POS 4
+
+#define MIN_RU_SEG (1 << 0)
+#define MIN_RU_POS 5
+#define MAX_RU_SEG (1 << 4)
+#define MAX_RU_POS 2
+
+#define MIN_EN_SEG (1 << 0)
+#define MIN_EN_POS 6
+#define MAX_EN_SEG (1 << 0)
+#define MAX_EN_POS 3
+
+#define BURST_RU_SEG (1 << 4)
+#define BURST_RU_POS 1
+#define BURST_EN_SEG (1 << 7)
+#define BURST_EN_POS 1
+
+#define LEAK_RU_SEG (1 << 6)
+#define LEAK_RU_POS 1
+#define LEAK_EN_SEG (1 << 3)
+#define LEAK_EN_POS 1
+
+#define REV_RU_SEG (1 << 2)
+#define REV_RU_POS 1
+#define REV_EN_SEG (1 << 1)
+#define REV_EN_POS 1
+
+#define FROST_SEG (1 << 0)
+#define FROST_POS 2
+
+#define Q_SEG (1 << 3)
+#define Q_POS 2
+
+#define VER_RU_SEG (1 << 1)
+#define VER_RU_POS 2
+#define VER_EN_SEG (1 << 2)
+#define VER_EN_POS 2
+
+#define SN_RU_SEG (1 << 5)
+#define SN_RU_POS 1
+#define SN_EN_SEG (1 << 7)
+#define SN_EN_POS 16
+
+#define WARN_SEG (1 << 0)
+#define WARN_POS 17
+
+#define MAGNET_SEG (1 << 4)
+#define MAGNET_POS 16
+
+#define LEFT_SEG (1 << 0)
+#define LEFT_POS 16
+
+#define RIGHT_SEG (1 << 0)
+#define RIGHT_POS 15
+
+#define NOWATER_SEG (1 << 4)
+#define NOWATER_POS 15
+
+#define CRC_SEG (1 << 6)
+#define CRC_POS 16
+
+#define DELTA_SEG (1 << 5)
+#define DELTA_POS 16
+
+#define T_SEG (1 << 2)
+#define T_POS 16
+
+#define T1_SEG (1 << 3)
+#define T1_POS 16
+
+#define T2_SEG (1 << 7)
+#define T2_POS 15
+
+#define NBFI_SEG (1 << 4)
+#define NBFI_POS 14
+
+#define NBIOT_SEG (1 << 0)
+#define NBIOT_POS 14
+
+#define SIG1_SEG (1 << 7)
+#define SIG1_POS 14
+#define SIG2_SEG (1 << 3)
+#define SIG2_POS 14
+#define SIG3_SEG (1 << 7)
+#define SIG3_POS 13
+
+#define DEGREE_SEG (1 << 6)
+#define DEGREE_POS 15
+
+#define GCAL_SEG (1 << 2)
+#define GCAL_POS 13
+#define GCAL_H_SEG (1 << 6)
+#define GCAL_H_POS 12
+
+#define GJ_SEG (1 << 5)
+#define GJ_POS 15
+#define GJ_H_SEG (1 << 1)
+#define GJ_H_POS 13
+
+#define KW_SEG (1 << 5)
+#define KW_POS 11
+#define MW_SEG (1 << 6)
+#define MW_POS 11
+#define W_SEG (1 << 5)
+#define W_POS 12
+#define WH_SEG (1 << 1)
+#define WH_POS 12
+
+#define GAL_SEG (1 << 2)
+#define GAL_POS 13
+#define GAL_PM_SEG (1 << 6)
+#define GAL_PM_POS 12
+
+#define M3_SEG (1 << 0)
+#define M3_POS 12
+#define M3_H_SEG (1 << 3)
+#define M3_H_POS 12
+#define M3_H_EN_SEG (1 << 4)
+#define M3_H_EN_POS 12
+
+#define FT3_SEG (1 << 2)
+#define FT3_POS 15
+#define FT3_PM_SEG (1 << 1)
+#define FT3_PM_POS 15
+
+#define MMBTU_SEG (1 << 3)
+#define MMBTU_POS 15
+
+#define GALLONS_SEG (1 << 5)
+#define GALLONS_POS 14
+#define US_SEG (1 << 6)
+#define US_POS 14
+
+#define ALL_CLEAR_SEG (0xfe << 0) //0b11111110
+#define ALL_CLEAR_POS 1
+
+#define DOT_SEG 0x80
+
+#endif //HT1620_LAYOUT_H